@@ -0,0 +1,53 @@
+// Compares two JSON reports written by `npm run bench -- --json <file>`.
+// Usage: npm run bench:compare -- <baseline.json> <candidate.json>
+//
+// Both reports must come from the same machine. To produce them:
+//   git checkout <baseline> && npm run build:c && npm run bench -- --json baseline.json
+//   git checkout <candidate> && npm run build:c && npm run bench -- --json candidate.json
+const fs = require('fs')
+
+const [baselineFile, candidateFile] = process.argv.slice(2)
+
+if (!baselineFile || !candidateFile) {
+  console.error('Usage: node bench/compare.js <baseline.json> <candidate.json>')
+  process.exit(1)
+}
+
+const baseline = JSON.parse(fs.readFileSync(baselineFile, 'utf8'))
+const candidate = JSON.parse(fs.readFileSync(candidateFile, 'utf8'))
+
+const change = (before, after) => before ? `${after >= before ? '+' : ''}${((after - before) / before * 100).toFixed(1)}%` : 'n/a'
+
+for (const key of ['platform', 'cpu', 'node', 'durationMs']) {
+  if (baseline[key] !== candidate[key]) {
+    console.warn(`Warning: reports differ in ${key} (${baseline[key]} vs ${candidate[key]}), so the numbers are not comparable`)
+  }
+}
+
+console.log(`baseline ${baseline.commit || baselineFile} vs candidate ${candidate.commit || candidateFile}\n`)
+console.log('shape\top\tns/op before\tns/op after\tns/op change\theap B/op before\theap B/op after\tnative B/op before\tnative B/op after')
+
+for (const result of candidate.results) {
+  const previous = baseline.results.find(r => r.shape === result.shape)
+
+  for (const op of result.operations) {
+    const previousOp = previous && previous.operations.find(o => o.name === op.name)
+
+    if (!previousOp) {
+      console.log([result.shape, op.name, '-', op.nsPerOp, 'new', '-', op.heapBytesPerOp, '-', op.nativeBytesPerOp].join('\t'))
+      continue
+    }
+
+    console.log([
+      result.shape,
+      op.name,
+      previousOp.nsPerOp,
+      op.nsPerOp,
+      change(previousOp.nsPerOp, op.nsPerOp),
+      previousOp.heapBytesPerOp,
+      op.heapBytesPerOp,
+      previousOp.nativeBytesPerOp ?? '-',
+      op.nativeBytesPerOp ?? '-'
+    ].join('\t'))
+  }
+}
@@ -0,0 +1,170 @@
+// Benchmarks JS→Fleece and Fleece→JS conversion over generated document shapes.
+// Build the addon first (`npm run build:c`), then run `npm run bench`. Options:
+//   --shape <name>     only run the named shape (repeatable)
+//   --duration <ms>    minimum time spent measuring each operation (default 500)
+//   --json <file>      also write the results as JSON, for `npm run bench:compare` against another commit
+const { execSync } = require('child_process')
+const fs = require('fs')
+const os = require('os')
+const { join } = require('path')
+const cblite = require('../build/Release/couchbaselite.node')
+const { shapes, countFields } = require('./shapes')
+
+const ALLOCATION_SAMPLE_OPS = 20
+const ALLOCATION_SAMPLES = 25
+
+function parseArgs(argv) {
+  const options = { shapes: [], duration: 500, json: null }
+
+  for (let i = 0; i < argv.length; i++) {
+    switch (argv[i]) {
+      case '--shape': options.shapes.push(argv[++i]); break
+      case '--duration': options.duration = Number(argv[++i]); break
+      case '--json': options.json = argv[++i]; break
+      default: throw new Error(`Unknown option ${argv[i]}`)
+    }
+  }
+
+  for (const shape of options.shapes) {
+    if (!shapes[shape]) throw new Error(`Unknown shape ${shape}, expected one of ${Object.keys(shapes).join(', ')}`)
+  }
+
+  if (options.shapes.length === 0) options.shapes = Object.keys(shapes)
+
+  return options
+}
+
+function measureTime(fn, durationMs) {
+  // Warm up so the first measured batch doesn't pay for lazy compilation
+  for (let i = 0; i < 100; i++) fn()
+
+  let iterations = 0
+  const start = process.hrtime.bigint()
+  let elapsed = 0n
+
+  do {
+    for (let i = 0; i < 100; i++) fn()
+    iterations += 100
+    elapsed = process.hrtime.bigint() - start
+  } while (elapsed < BigInt(durationMs) * 1000000n)
+
+  return Number(elapsed) / iterations
+}
+
+// Allocations per operation. JS heap bytes are the median heap growth over short batches, ignoring batches during
+// which a garbage collection shrank the heap. Native allocations are the addon's own conversion buffers, which
+// process.memoryUsage() doesn't see; allocations made inside Couchbase Lite and Fleece are still not counted.
+function measureAllocations(fn) {
+  const samples = []
+
+  for (let attempt = 0; samples.length < ALLOCATION_SAMPLES && attempt < ALLOCATION_SAMPLES * 4; attempt++) {
+    if (global.gc) global.gc()
+
+    const before = process.memoryUsage()
+    const nativeBefore = cblite._convertAllocationStats()
+    for (let i = 0; i < ALLOCATION_SAMPLE_OPS; i++) fn()
+    const nativeAfter = cblite._convertAllocationStats()
+    const after = process.memoryUsage()
+    const heap = after.heapUsed - before.heapUsed
+
+    if (heap >= 0) {
+      samples.push({
+        heap,
+        external: Math.max(0, after.external - before.external),
+        nativeCount: nativeAfter.count - nativeBefore.count,
+        nativeBytes: nativeAfter.bytes - nativeBefore.bytes
+      })
+    }
+  }
+
+  if (samples.length === 0) return null
+
+  const median = key => samples.map(sample => sample[key]).sort((a, b) => a - b)[samples.length >> 1] / ALLOCATION_SAMPLE_OPS
+
+  return {
+    heapBytes: Math.round(median('heap')),
+    externalBytes: Math.round(median('external')),
+    nativeAllocs: Number(median('nativeCount').toFixed(2)),
+    nativeBytes: Math.round(median('nativeBytes'))
+  }
+}
+
+function benchmark(name, fieldCount, fn, durationMs) {
+  const nsPerOp = measureTime(fn, durationMs)
+  const allocations = measureAllocations(fn)
+
+  return {
+    name,
+    opsPerSec: Math.round(1e9 / nsPerOp),
+    nsPerOp: Math.round(nsPerOp),
+    nsPerField: Number((nsPerOp / fieldCount).toFixed(2)),
+    heapBytesPerOp: allocations && allocations.heapBytes,
+    externalBytesPerOp: allocations && allocations.externalBytes,
+    nativeAllocsPerOp: allocations && allocations.nativeAllocs,
+    nativeBytesPerOp: allocations && allocations.nativeBytes
+  }
+}
+
+function gitCommit() {
+  try {
+    return execSync('git rev-parse --short HEAD', { cwd: __dirname, stdio: ['ignore', 'pipe', 'ignore'] }).toString().trim()
+  } catch (e) {
+    return null
+  }
+}
+
+function run(options) {
+  const directory = fs.mkdtempSync(join(os.tmpdir(), 'cblite-bench-'))
+  const db = cblite.openDatabase('bench', directory)
+  const results = []
+
+  if (!global.gc) console.warn('Run with --expose-gc (as `npm run bench` does) for stable allocation numbers\n')
+
+  try {
+    console.log('shape\tfields\top\tops/sec\tns/op\tns/field\theap B/op\texternal B/op\tnative allocs/op\tnative B/op')
+
+    for (const shape of options.shapes) {
+      const properties = shapes[shape]()
+      const fieldCount = countFields(properties)
+      const mutableDoc = cblite.createDocument(shape)
+
+      cblite.setDocumentProperties(mutableDoc, properties)
+      cblite.saveDocument(db, mutableDoc)
+
+      const doc = cblite.getDocument(db, shape)
+      const operations = [
+        benchmark('write', fieldCount, () => cblite.setDocumentProperties(mutableDoc, properties), options.duration),
+        benchmark('read', fieldCount, () => cblite.getDocumentProperties(doc), options.duration)
+      ]
+
+      for (const op of operations) {
+        console.log([shape, fieldCount, op.name, op.opsPerSec, op.nsPerOp, op.nsPerField, op.heapBytesPerOp, op.externalBytesPerOp, op.nativeAllocsPerOp, op.nativeBytesPerOp].join('\t'))
+      }
+
+      results.push({ shape, fieldCount, operations })
+    }
+  } finally {
+    cblite.deleteDatabase(db)
+    fs.rmSync(directory, { recursive: true, force: true })
+  }
+
+  return results
+}
+
+const options = parseArgs(process.argv.slice(2))
+const results = run(options)
+
+if (options.json) {
+  const report = {
+    commit: gitCommit(),
+    date: new Date().toISOString(),
+    node: process.version,
+    platform: `${os.platform()}-${os.arch()}`,
+    cpu: os.cpus()[0] && os.cpus()[0].model,
+    durationMs: options.duration,
+    results
+  }
+
+  fs.writeFileSync(options.json, `${JSON.stringify(report, null, 2)}\n`)
+  console.log(`\nWrote ${options.json}`)
+}
@@ -0,0 +1,102 @@
+// Generated document shapes for the conversion benchmarks. Every generator is deterministic, so results from
+// different commits measure exactly the same documents.
+
+function mixedValue(i) {
+  switch (i % 4) {
+    case 0: return `value ${i}`
+    case 1: return i
+    case 2: return i / 3
+    default: return i % 2 === 0
+  }
+}
+
+function flat() {
+  const doc = {}
+
+  for (let i = 0; i < 20; i++) doc[`field${i}`] = mixedValue(i)
+
+  return doc
+}
+
+// The 50-500 field sweep of the original wide-documents benchmark, with the same values, so its numbers can still be
+// reproduced with `--shape wide-50` and so on
+const WIDE_FIELD_COUNTS = [50, 100, 200, 500]
+
+function wide(fieldCount) {
+  const doc = {}
+
+  for (let i = 0; i < fieldCount; i++) doc[`field${i}`] = mixedValue(i)
+
+  return doc
+}
+
+function deep() {
+  let doc = { name: 'leaf', value: 0 }
+
+  for (let i = 1; i < 64; i++) {
+    doc = i % 2 === 0
+      ? { name: `level ${i}`, value: i, child: doc }
+      : { name: `level ${i}`, values: [i, doc] }
+  }
+
+  return doc
+}
+
+function stringHeavy() {
+  const doc = {}
+  const words = ['couch', 'base', 'lite', 'fleece', 'ümlaut', 'naïve', '🏡', 'document']
+
+  for (let i = 0; i < 100; i++) {
+    let value = ''
+
+    while (value.length < 16 + (i * 37) % 240) value += `${words[(i + value.length) % words.length]} `
+    doc[`text${i}`] = value
+  }
+
+  return doc
+}
+
+function numberHeavy() {
+  const doc = {}
+
+  for (let i = 0; i < 200; i++) {
+    switch (i % 5) {
+      case 0: doc[`number${i}`] = i; break
+      case 1: doc[`number${i}`] = -i * 1000003; break
+      case 2: doc[`number${i}`] = i * 0.1; break
+      case 3: doc[`number${i}`] = 2 ** 40 + i; break
+      default: doc[`number${i}`] = Math.PI * i
+    }
+  }
+
+  return doc
+}
+
+function arrayHeavy() {
+  return {
+    numbers: Array.from({ length: 500 }, (_, i) => i),
+    strings: Array.from({ length: 200 }, (_, i) => `item ${i}`),
+    matrix: Array.from({ length: 20 }, (_, i) => Array.from({ length: 20 }, (_, j) => i * j)),
+    records: Array.from({ length: 50 }, (_, i) => ({ id: i, tags: [`tag${i % 7}`, `tag${i % 11}`] }))
+  }
+}
+
+// Number of values in a document, counting containers as well as scalars
+function countFields(value) {
+  if (Array.isArray(value)) return value.reduce((count, item) => count + 1 + countFields(item), 0)
+  if (value && typeof value === 'object') return Object.values(value).reduce((count, item) => count + 1 + countFields(item), 0)
+
+  return 0
+}
+
+module.exports = {
+  shapes: {
+    flat,
+    ...Object.fromEntries(WIDE_FIELD_COUNTS.map(fieldCount => [`wide-${fieldCount}`, () => wide(fieldCount)])),
+    deep,
+    'string-heavy': stringHeavy,
+    'number-heavy': numberHeavy,
+    'array-heavy': arrayHeavy
+  },
+  countFields
+}
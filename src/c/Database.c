@@ -1,58 +1,111 @@
 #include <assert.h>
+#include <dirent.h>
 #include <node_api.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <uv.h>
 #include "cbl/CouchbaseLite.h"
+#include "DocumentCache.h"
 #include "Listener.h"
+#include "NapiConvert.h"
 #include "util.h"
 
+static void releaseDocumentCache(napi_env env, external_database_ref *databaseRef)
+{
+  if (databaseRef->documentCache)
+  {
+    // Stopping drops the change listener now, even if async work still holds on to the cache; it is freed once the
+    // database is closed
+    documentCache_Retire(env, databaseRef->documentCache, &databaseRef->stoppedDocumentCaches);
+    databaseRef->documentCache = NULL;
+  }
+}
+
 static void finalize_database_external(napi_env env, void *data, void *hint)
 {
   external_database_ref *databaseRef = (external_database_ref *)data;
 
+  releaseDocumentCache(env, databaseRef);
+
   if (databaseRef->isOpen)
   {
     CBLDatabase_Close(databaseRef->database, NULL);
   }
 
+  documentCache_ReleaseStopped(env, &databaseRef->stoppedDocumentCaches);
   CBLDatabase_Release(databaseRef->database);
   free(data);
 }
 
+// Opens in the given directory, or the default one if directory is null. Safe to call off the JS thread.
+static CBLDatabase *openDatabase(FLString name, FLString directory, CBLError *err)
+{
+  if (!directory.buf)
+  {
+    return CBLDatabase_Open(name, NULL, err);
+  }
+
+  CBLDatabaseConfiguration config = CBLDatabaseConfiguration_Default();
+  config.directory = directory;
+
+  return CBLDatabase_Open(name, &config, err);
+}
+
+// Reads the name and optional directory arguments of openDatabase, which may be of any length. Returns false after
+// throwing if they are invalid.
+static bool napiValuesToDatabaseLocation(napi_env env, napi_value name, napi_value directory, convert_arena *arena, FLString *nameOut, FLString *directoryOut)
+{
+  napi_valuetype nameType;
+  CHECK(napi_typeof(env, name, &nameType));
+
+  napi_valuetype directoryType;
+  CHECK(napi_typeof(env, directory, &directoryType));
+
+  if (nameType != napi_string)
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: database name must be a string");
+    return false;
+  }
+
+  if (directoryType != napi_string && directoryType != napi_undefined && directoryType != napi_null)
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: directory must be a string");
+    return false;
+  }
+
+  *nameOut = napiValueToFLString(env, name, arena);
+  *directoryOut = directoryType == napi_string ? napiValueToFLString(env, directory, arena) : kFLSliceNull;
+
+  return true;
+}
+
 // CBLDatabase_Open
 napi_value Database_Open(napi_env env, napi_callback_info info)
 {
   CBLError err;
-  CBLDatabase *database;
 
   size_t argc = 2;
-  napi_value args[argc];
-
+  napi_value args[2];
   CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
-  assertType(env, args[0], napi_string, "Wrong arguments: database name must be a string");
 
-  size_t buffer_size = 128;
-  char dbName[buffer_size];
-  napi_get_value_string_utf8(env, args[0], dbName, buffer_size, NULL);
+  convert_arena arena;
+  convertArena_Init(&arena);
 
-  napi_valuetype directoryValueType;
-  CHECK(napi_typeof(env, args[1], &directoryValueType));
+  FLString name;
+  FLString directory;
+  CBLDatabase *database = NULL;
 
-  if (directoryValueType == napi_string)
+  if (!napiValuesToDatabaseLocation(env, args[0], args[1], &arena, &name, &directory))
   {
-    size_t buffer_size = 128;
-    char directory[buffer_size];
-    napi_get_value_string_utf8(env, args[1], directory, buffer_size, NULL);
-
-    CBLDatabaseConfiguration config;
-    config.directory = FLStr(directory);
-
-    database = CBLDatabase_Open(FLStr(dbName), &config, &err);
-  }
-  else
-  {
-    database = CBLDatabase_Open(FLStr(dbName), NULL, &err);
+    convertArena_Free(&arena);
+    return NULL;
   }
 
+  database = openDatabase(name, directory, &err);
+  convertArena_Free(&arena);
+
   if (!database)
   {
     throwCBLError(env, err);
@@ -67,6 +120,167 @@ napi_value Database_Open(napi_env env, napi_callback_info info)
   return res;
 }
 
+// The location and warmup queries are copied, so the work owns everything it reads on the worker thread
+typedef struct OpenDatabaseWork
+{
+  async_work_data async;
+  FLSliceResult name;
+  FLSliceResult directory;
+  FLSliceResult *warmupQueries;
+  uint32_t warmupQueryCount;
+  CBLDatabase *database;
+} open_database_work;
+
+// Compiles and runs each query to the end, so the first real request finds its indexes and pages cached
+static bool warmUpDatabase(CBLDatabase *database, FLSliceResult *queries, uint32_t count, CBLError *err)
+{
+  for (uint32_t i = 0; i < count; i++)
+  {
+    CBLQuery *query = CBLDatabase_CreateQuery(database, kCBLN1QLLanguage, FLSliceResult_AsSlice(queries[i]), NULL, err);
+
+    if (!query)
+    {
+      return false;
+    }
+
+    CBLResultSet *results = CBLQuery_Execute(query, err);
+    CBLQuery_Release(query);
+
+    if (!results)
+    {
+      return false;
+    }
+
+    while (CBLResultSet_Next(results))
+    {
+    }
+
+    CBLResultSet_Release(results);
+  }
+
+  return true;
+}
+
+static void OpenDatabaseAsync_Free(open_database_work *work)
+{
+  for (uint32_t i = 0; i < work->warmupQueryCount; i++)
+  {
+    FLSliceResult_Release(work->warmupQueries[i]);
+  }
+
+  free(work->warmupQueries);
+  FLSliceResult_Release(work->name);
+  FLSliceResult_Release(work->directory);
+  free(work);
+}
+
+static void OpenDatabaseAsync_Execute(napi_env env, void *data)
+{
+  open_database_work *work = (open_database_work *)data;
+
+  work->database = openDatabase(FLSliceResult_AsSlice(work->name), FLSliceResult_AsSlice(work->directory), &work->async.err);
+
+  if (work->database && !warmUpDatabase(work->database, work->warmupQueries, work->warmupQueryCount, &work->async.err))
+  {
+    CBLError closeErr;
+    CBLDatabase_Close(work->database, &closeErr);
+    CBLDatabase_Release(work->database);
+    work->database = NULL;
+  }
+}
+
+static void OpenDatabaseAsync_Complete(napi_env env, napi_status status, void *data)
+{
+  open_database_work *work = (open_database_work *)data;
+
+  napi_value res = NULL;
+  if (work->database)
+  {
+    // The external takes over the reference returned by CBL
+    external_database_ref *databaseRef = createExternalDatabaseRef(work->database);
+    CHECK(napi_create_external(env, databaseRef, finalize_database_external, NULL, &res));
+  }
+
+  finishAsyncWork(env, &work->async, res);
+  OpenDatabaseAsync_Free(work);
+}
+
+// CBLDatabase_Open, off the JS thread, optionally followed by running { warmup } N1QL queries
+napi_value Database_OpenAsync(napi_env env, napi_callback_info info)
+{
+  size_t argc = 3;
+  napi_value args[3];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  napi_value warmup = NULL;
+  napi_valuetype optionsType;
+  CHECK(napi_typeof(env, args[2], &optionsType));
+
+  if (optionsType == napi_object)
+  {
+    napi_valuetype warmupType;
+    CHECK(napi_get_named_property(env, args[2], "warmup", &warmup));
+    CHECK(napi_typeof(env, warmup, &warmupType));
+
+    if (warmupType == napi_undefined)
+    {
+      warmup = NULL;
+    }
+    else if (!isArray(env, warmup))
+    {
+      napi_throw_type_error(env, NULL, "Wrong arguments: warmup must be an array of N1QL queries");
+      return rejectPendingException(env);
+    }
+  }
+
+  convert_arena arena;
+  convertArena_Init(&arena);
+
+  FLString name;
+  FLString directory;
+
+  if (!napiValuesToDatabaseLocation(env, args[0], args[1], &arena, &name, &directory))
+  {
+    convertArena_Free(&arena);
+    return rejectPendingException(env);
+  }
+
+  open_database_work *work = calloc(1, sizeof(*work));
+  work->name = FLSlice_Copy(name);
+  work->directory = FLSlice_Copy(directory);
+
+  if (warmup)
+  {
+    CHECK(napi_get_array_length(env, warmup, &work->warmupQueryCount));
+    work->warmupQueries = calloc(work->warmupQueryCount, sizeof(*work->warmupQueries));
+
+    for (uint32_t i = 0; i < work->warmupQueryCount; i++)
+    {
+      napi_value query;
+      napi_valuetype queryType;
+      CHECK(napi_get_element(env, warmup, i, &query));
+      CHECK(napi_typeof(env, query, &queryType));
+
+      if (queryType != napi_string)
+      {
+        napi_throw_type_error(env, NULL, "Wrong arguments: warmup must be an array of N1QL queries");
+        work->warmupQueryCount = i;
+        OpenDatabaseAsync_Free(work);
+        convertArena_Free(&arena);
+        return rejectPendingException(env);
+      }
+
+      convert_arena_mark mark = convertArena_Mark(&arena);
+      work->warmupQueries[i] = FLSlice_Copy(napiValueToFLString(env, query, &arena));
+      convertArena_Rewind(&arena, mark);
+    }
+  }
+
+  convertArena_Free(&arena);
+
+  return queueAsyncWork(env, "couchbase-lite open database", OpenDatabaseAsync_Execute, OpenDatabaseAsync_Complete, &work->async);
+}
+
 // CBLDatabase_Close
 napi_value Database_Close(napi_env env, napi_callback_info info)
 {
@@ -88,11 +302,14 @@ napi_value Database_Close(napi_env env, napi_callback_info info)
     return res;
   }
 
+  releaseDocumentCache(env, databaseRef);
+
   bool didClose = CBLDatabase_Close(databaseRef->database, &err);
 
   if (didClose)
   {
     databaseRef->isOpen = false;
+    documentCache_ReleaseStopped(env, &databaseRef->stoppedDocumentCaches);
   }
   else
   {
@@ -132,6 +349,8 @@ napi_value Database_Delete(napi_env env, napi_callback_info info)
     external_database_ref *databaseRef;
     CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
 
+    releaseDocumentCache(env, databaseRef);
+
     CBLError err;
     bool didDelete = CBLDatabase_Delete(databaseRef->database, &err);
     CHECK(napi_get_boolean(env, didDelete, &res));
@@ -139,6 +358,7 @@ napi_value Database_Delete(napi_env env, napi_callback_info info)
     if (didDelete)
     {
       databaseRef->isOpen = false;
+      documentCache_ReleaseStopped(env, &databaseRef->stoppedDocumentCaches);
     }
     else
     {
@@ -153,17 +373,22 @@ napi_value Database_Delete(napi_env env, napi_callback_info info)
       return res;
     }
 
-    size_t buffer_size = 128;
-    char dbName[buffer_size];
-    napi_get_value_string_utf8(env, args[0], dbName, buffer_size, NULL);
+    napi_valuetype directoryType;
+    CHECK(napi_typeof(env, args[1], &directoryType));
 
-    assertType(env, args[1], napi_string, "Wrong arguments: directory must be a string");
+    if (directoryType != napi_string)
+    {
+      napi_throw_type_error(env, NULL, "Wrong arguments: directory must be a string");
+      return res;
+    }
 
-    char directory[buffer_size];
-    napi_get_value_string_utf8(env, args[1], directory, buffer_size, NULL);
+    convert_arena arena;
+    convertArena_Init(&arena);
 
     CBLError err;
-    bool didDelete = CBL_DeleteDatabase(FLStr(dbName), FLStr(directory), &err);
+    FLString dbName = napiValueToFLString(env, args[0], &arena);
+    bool didDelete = CBL_DeleteDatabase(dbName, napiValueToFLString(env, args[1], &arena), &err);
+    convertArena_Free(&arena);
 
     if (!didDelete)
     {
@@ -201,6 +426,13 @@ napi_value Database_BeginTransaction(napi_env env, napi_callback_info info)
     return NULL;
   }
 
+  if (databaseRef->transactionDepth++ == 0)
+  {
+    databaseRef->transactionStart = uv_hrtime();
+    databaseRef->transactionEnd = 0;
+    databaseRef->transactionOps = 0;
+  }
+
   CHECK(napi_get_boolean(env, true, &res));
   return res;
 }
@@ -224,6 +456,12 @@ napi_value Database_EndTransaction(napi_env env, napi_callback_info info)
   CBLError err;
   bool didEnd = CBLDatabase_EndTransaction(databaseRef->database, commit, &err);
 
+  // CBL closes the transaction level even when ending it fails
+  if (databaseRef->transactionDepth > 0 && --databaseRef->transactionDepth == 0)
+  {
+    databaseRef->transactionEnd = uv_hrtime();
+  }
+
   if (!didEnd)
   {
     throwCBLError(env, err);
@@ -234,6 +472,132 @@ napi_value Database_EndTransaction(napi_env env, napi_callback_info info)
   return res;
 }
 
+// Depth, writes and duration of the current transaction, or of the last one once it has ended
+napi_value Database_TransactionStats(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+
+  uint64_t end = databaseRef->transactionDepth > 0 ? uv_hrtime() : databaseRef->transactionEnd;
+  double durationMs = databaseRef->transactionStart ? (double)(end - databaseRef->transactionStart) / 1e6 : 0;
+
+  napi_value res;
+  CHECK(napi_create_object(env, &res));
+
+  napi_value depth;
+  CHECK(napi_create_uint32(env, databaseRef->transactionDepth, &depth));
+  CHECK(napi_set_named_property(env, res, "depth", depth));
+
+  napi_value ops;
+  CHECK(napi_create_int64(env, (int64_t)databaseRef->transactionOps, &ops));
+  CHECK(napi_set_named_property(env, res, "ops", ops));
+
+  napi_value duration;
+  CHECK(napi_create_double(env, durationMs, &duration));
+  CHECK(napi_set_named_property(env, res, "durationMs", duration));
+
+  return res;
+}
+
+#define DOCUMENT_CACHE_DEFAULT_MAX_DOCUMENTS 1000
+
+// Keeps recently read immutable documents, and optionally their frozen JS properties, in a bounded LRU
+napi_value Database_EnableDocumentCache(napi_env env, napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
+
+  uint32_t maxDocuments = DOCUMENT_CACHE_DEFAULT_MAX_DOCUMENTS;
+  bool cacheProperties = false;
+
+  napi_valuetype optionsType;
+  CHECK(napi_typeof(env, args[1], &optionsType));
+
+  if (optionsType == napi_object)
+  {
+    if (!napiOptionToPositiveUInt32(env, args[1], "maxDocuments", &maxDocuments) || !napiOptionToCBool(env, args[1], "properties", &cacheProperties))
+    {
+      return NULL;
+    }
+  }
+
+  // Re-enabling replaces the cache, so new options apply to a clean slate
+  releaseDocumentCache(env, databaseRef);
+  databaseRef->documentCache = documentCache_New(databaseRef->database, maxDocuments, cacheProperties);
+
+  napi_value res;
+  CHECK(napi_get_boolean(env, true, &res));
+
+  return res;
+}
+
+napi_value Database_DisableDocumentCache(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+
+  releaseDocumentCache(env, databaseRef);
+
+  napi_value res;
+  CHECK(napi_get_boolean(env, true, &res));
+
+  return res;
+}
+
+static void setNamedInt64(napi_env env, napi_value object, const char *name, int64_t value)
+{
+  napi_value napiValue;
+  CHECK(napi_create_int64(env, value, &napiValue));
+  CHECK(napi_set_named_property(env, object, name, napiValue));
+}
+
+napi_value Database_DocumentCacheStats(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+
+  napi_value res;
+
+  if (!databaseRef->documentCache)
+  {
+    CHECK(napi_get_null(env, &res));
+    return res;
+  }
+
+  document_cache_stats stats = documentCache_Stats(env, databaseRef->documentCache);
+
+  CHECK(napi_create_object(env, &res));
+  setNamedInt64(env, res, "hits", (int64_t)stats.hits);
+  setNamedInt64(env, res, "misses", (int64_t)stats.misses);
+  setNamedInt64(env, res, "evictions", (int64_t)stats.evictions);
+  setNamedInt64(env, res, "invalidations", (int64_t)stats.invalidations);
+  setNamedInt64(env, res, "count", stats.count);
+  setNamedInt64(env, res, "capacity", stats.capacity);
+
+  return res;
+}
+
 // CBLDatabase_Name
 napi_value Database_Name(napi_env env, napi_callback_info info)
 {
@@ -273,6 +637,307 @@ napi_value Database_Path(napi_env env, napi_callback_info info)
   return res;
 }
 
+// Bytes on disk of a database bundle, by the SQLite file, its write-ahead log and shared memory index, and the
+// attachments (blobs) directory. total also counts anything else in the bundle.
+typedef struct DatabaseFileSizes
+{
+  uint64_t total;
+  uint64_t sqlite;
+  uint64_t wal;
+  uint64_t shm;
+  uint64_t attachments;
+} database_file_sizes;
+
+static char *joinPath(const char *directory, size_t directorySize, const char *name)
+{
+  size_t nameSize = strlen(name);
+  char *path = malloc(directorySize + nameSize + 2);
+
+  memcpy(path, directory, directorySize);
+  size_t size = directorySize;
+
+  if (size == 0 || path[size - 1] != '/')
+  {
+    path[size++] = '/';
+  }
+
+  memcpy(path + size, name, nameSize + 1);
+
+  return path;
+}
+
+// Size of a file, or of the files directly inside a directory
+static uint64_t pathSize(const char *path)
+{
+  struct stat info;
+
+  if (stat(path, &info) != 0)
+  {
+    return 0;
+  }
+
+  if (!S_ISDIR(info.st_mode))
+  {
+    return (uint64_t)info.st_size;
+  }
+
+  uint64_t size = 0;
+  DIR *directory = opendir(path);
+  struct dirent *entry;
+
+  while (directory && (entry = readdir(directory)))
+  {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+    {
+      char *entryPath = joinPath(path, strlen(path), entry->d_name);
+
+      if (stat(entryPath, &info) == 0 && S_ISREG(info.st_mode))
+      {
+        size += (uint64_t)info.st_size;
+      }
+
+      free(entryPath);
+    }
+  }
+
+  if (directory)
+  {
+    closedir(directory);
+  }
+
+  return size;
+}
+
+// Safe to call off the JS thread
+static database_file_sizes getDatabaseFileSizes(CBLDatabase *database)
+{
+  database_file_sizes sizes = {0};
+
+  FLStringResult bundlePath = CBLDatabase_Path(database);
+  char *bundle = joinPath(bundlePath.buf, bundlePath.size, "");
+  FLSliceResult_Release(bundlePath);
+
+  DIR *directory = opendir(bundle);
+  struct dirent *entry;
+
+  while (directory && (entry = readdir(directory)))
+  {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+    {
+      continue;
+    }
+
+    char *path = joinPath(bundle, strlen(bundle), entry->d_name);
+    uint64_t size = pathSize(path);
+    free(path);
+
+    sizes.total += size;
+
+    if (strcmp(entry->d_name, "db.sqlite3") == 0)
+    {
+      sizes.sqlite = size;
+    }
+    else if (strcmp(entry->d_name, "db.sqlite3-wal") == 0)
+    {
+      sizes.wal = size;
+    }
+    else if (strcmp(entry->d_name, "db.sqlite3-shm") == 0)
+    {
+      sizes.shm = size;
+    }
+    else if (strcmp(entry->d_name, "Attachments") == 0)
+    {
+      sizes.attachments = size;
+    }
+  }
+
+  if (directory)
+  {
+    closedir(directory);
+  }
+
+  free(bundle);
+
+  return sizes;
+}
+
+static napi_value databaseFileSizesToNapiObject(napi_env env, database_file_sizes *sizes)
+{
+  napi_value res;
+  CHECK(napi_create_object(env, &res));
+  setNamedInt64(env, res, "total", (int64_t)sizes->total);
+  setNamedInt64(env, res, "sqlite", (int64_t)sizes->sqlite);
+  setNamedInt64(env, res, "wal", (int64_t)sizes->wal);
+  setNamedInt64(env, res, "shm", (int64_t)sizes->shm);
+  setNamedInt64(env, res, "attachments", (int64_t)sizes->attachments);
+
+  return res;
+}
+
+static const char *maintenanceTypeNames[] = {
+    [kCBLMaintenanceTypeCompact] = "compact",
+    [kCBLMaintenanceTypeReindex] = "reindex",
+    [kCBLMaintenanceTypeIntegrityCheck] = "integrityCheck",
+    [kCBLMaintenanceTypeOptimize] = "optimize",
+    [kCBLMaintenanceTypeFullOptimize] = "fullOptimize",
+};
+
+#define MAINTENANCE_TYPE_COUNT (sizeof(maintenanceTypeNames) / sizeof(*maintenanceTypeNames))
+
+typedef struct MaintenanceWork
+{
+  async_work_data async;
+  CBLDatabase *database;
+  CBLMaintenanceType type;
+  database_file_sizes before;
+  database_file_sizes after;
+  uint64_t elapsed;
+} maintenance_work;
+
+static void PerformMaintenance_Execute(napi_env env, void *data)
+{
+  maintenance_work *work = (maintenance_work *)data;
+
+  work->before = getDatabaseFileSizes(work->database);
+
+  uint64_t start = uv_hrtime();
+  CBLDatabase_PerformMaintenance(work->database, work->type, &work->async.err);
+  work->elapsed = uv_hrtime() - start;
+
+  work->after = getDatabaseFileSizes(work->database);
+}
+
+static void PerformMaintenance_Complete(napi_env env, napi_status status, void *data)
+{
+  maintenance_work *work = (maintenance_work *)data;
+
+  napi_value res;
+  CHECK(napi_create_object(env, &res));
+
+  napi_value type;
+  CHECK(napi_create_string_utf8(env, maintenanceTypeNames[work->type], NAPI_AUTO_LENGTH, &type));
+  CHECK(napi_set_named_property(env, res, "type", type));
+  CHECK(napi_set_named_property(env, res, "before", databaseFileSizesToNapiObject(env, &work->before)));
+  CHECK(napi_set_named_property(env, res, "after", databaseFileSizesToNapiObject(env, &work->after)));
+
+  napi_value duration;
+  CHECK(napi_create_double(env, (double)work->elapsed / 1e6, &duration));
+  CHECK(napi_set_named_property(env, res, "durationMs", duration));
+
+  finishAsyncWork(env, &work->async, res);
+
+  CBLDatabase_Release(work->database);
+  free(work);
+}
+
+// CBLDatabase_PerformMaintenance, off the JS thread
+napi_value Database_PerformMaintenance(napi_env env, napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    return createRejectedPromise(env, "Database is closed");
+  }
+
+  napi_valuetype typeType;
+  CHECK(napi_typeof(env, args[1], &typeType));
+
+  char typeName[16] = "";
+  if (typeType == napi_string)
+  {
+    CHECK(napi_get_value_string_utf8(env, args[1], typeName, sizeof(typeName), NULL));
+  }
+
+  size_t type = 0;
+  while (type < MAINTENANCE_TYPE_COUNT && strcmp(typeName, maintenanceTypeNames[type]) != 0)
+  {
+    type++;
+  }
+
+  if (type == MAINTENANCE_TYPE_COUNT)
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: maintenance type must be 'compact', 'reindex', 'integrityCheck', 'optimize' or 'fullOptimize'");
+    return rejectPendingException(env);
+  }
+
+  maintenance_work *work = calloc(1, sizeof(*work));
+  work->database = CBLDatabase_Retain(databaseRef->database);
+  work->type = (CBLMaintenanceType)type;
+
+  return queueAsyncWork(env, "couchbase-lite perform maintenance", PerformMaintenance_Execute, PerformMaintenance_Complete, &work->async);
+}
+
+// Highest sequence of a live document. CBL 3.0 has no accessor for the database's last sequence, so this queries the
+// sequence index; changes from deletions and purges after the last live document aren't reflected.
+static bool lastDocumentSequence(CBLDatabase *database, uint64_t *sequence, CBLError *err)
+{
+  *sequence = 0;
+
+  CBLQuery *query = CBLDatabase_CreateQuery(database, kCBLN1QLLanguage, FLSTR("SELECT META().sequence FROM _ ORDER BY META().sequence DESC LIMIT 1"), NULL, err);
+
+  if (!query)
+  {
+    return false;
+  }
+
+  CBLResultSet *results = CBLQuery_Execute(query, err);
+  CBLQuery_Release(query);
+
+  if (!results)
+  {
+    return false;
+  }
+
+  if (CBLResultSet_Next(results))
+  {
+    *sequence = FLValue_AsUnsigned(CBLResultSet_ValueAtIndex(results, 0));
+  }
+
+  CBLResultSet_Release(results);
+
+  return true;
+}
+
+// CBLDatabase_Count, the last document sequence and the bundle's size on disk
+napi_value Database_Stats(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
+
+  CBLError err;
+  uint64_t lastSequence;
+
+  if (!lastDocumentSequence(databaseRef->database, &lastSequence, &err))
+  {
+    throwCBLError(env, err);
+    return NULL;
+  }
+
+  database_file_sizes sizes = getDatabaseFileSizes(databaseRef->database);
+
+  napi_value res;
+  CHECK(napi_create_object(env, &res));
+  setNamedInt64(env, res, "count", (int64_t)CBLDatabase_Count(databaseRef->database));
+  setNamedInt64(env, res, "lastSequence", (int64_t)lastSequence);
+  CHECK(napi_set_named_property(env, res, "fileSizes", databaseFileSizesToNapiObject(env, &sizes)));
+
+  return res;
+}
+
 struct ChangedDocs
 {
   char **docIDs;
@@ -1,7 +1,10 @@
 #include <assert.h>
+#include <math.h>
 #include <node_api.h>
 #include <stdio.h>
+#include <string.h>
 #include "cbl/CouchbaseLite.h"
+#include "DocumentCache.h"
 #include "NapiConvert.h"
 #include "Listener.h"
 #include "util.h"
@@ -14,6 +17,30 @@ static void finalize_document_external(napi_env env, void *data, void *hint)
   free(data);
 }
 
+// Reads through the database's document cache, when it has one
+static const CBLDocument *getCachedDocument(document_cache *cache, CBLDatabase *database, FLString docID, CBLError *err)
+{
+  return cache ? documentCache_GetDocument(cache, database, docID, err) : CBLDatabase_GetDocument(database, docID, err);
+}
+
+// Drops a written document from the cache straight away, rather than when the change listener catches up
+static void invalidateCachedDocument(document_cache *cache, const CBLDocument *doc)
+{
+  if (cache)
+  {
+    documentCache_Invalidate(cache, CBLDocument_ID(doc));
+  }
+}
+
+// Only writes inside a transaction count, so the stats of the last one aren't changed by writes made after it ended
+static void countTransactionOp(external_database_ref *databaseRef)
+{
+  if (databaseRef->transactionDepth > 0)
+  {
+    databaseRef->transactionOps++;
+  }
+}
+
 // CBLDocument_ID
 napi_value Document_ID(napi_env env, napi_callback_info info)
 {
@@ -33,6 +60,85 @@ napi_value Document_ID(napi_env env, napi_callback_info info)
   return res;
 }
 
+// CBLDocument_RevisionID
+napi_value Document_RevisionID(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
+
+  // Unsaved documents have no revision yet
+  FLString revisionID = CBLDocument_RevisionID(docRef->document);
+
+  napi_value res;
+  if (revisionID.buf)
+  {
+    CHECK(napi_create_string_utf8(env, revisionID.buf, revisionID.size, &res));
+  }
+  else
+  {
+    CHECK(napi_get_null(env, &res));
+  }
+
+  return res;
+}
+
+// CBLDocument_Sequence, of a document ref or of a stored document looked up by ID. The lookup loads the document
+// but never converts its properties.
+napi_value Document_Sequence(napi_env env, napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  napi_value res;
+
+  if (argc < 2)
+  {
+    external_document_ref *docRef;
+    CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
+    CHECK(napi_create_int64(env, (int64_t)CBLDocument_Sequence(docRef->document), &res));
+
+    return res;
+  }
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
+
+  convert_arena arena;
+  convertArena_Init(&arena);
+
+  CBLError err;
+  err.code = 0;
+  const CBLDocument *doc = getCachedDocument(databaseRef->documentCache, databaseRef->database, napiValueToFLString(env, args[1], &arena), &err);
+  convertArena_Free(&arena);
+
+  if (doc)
+  {
+    CHECK(napi_create_int64(env, (int64_t)CBLDocument_Sequence(doc), &res));
+    CBLDocument_Release(doc);
+  }
+  else if (err.code == 0)
+  {
+    CHECK(napi_get_null(env, &res));
+  }
+  else
+  {
+    throwCBLError(env, err);
+    return NULL;
+  }
+
+  return res;
+}
+
 // CBLDatabase_GetDocument
 napi_value Database_GetDocument(napi_env env, napi_callback_info info)
 {
@@ -50,11 +156,12 @@ napi_value Database_GetDocument(napi_env env, napi_callback_info info)
     return NULL;
   }
 
-  size_t buffer_size = 128;
-  char docID[buffer_size];
-  CHECK(napi_get_value_string_utf8(env, args[1], docID, buffer_size, NULL));
+  convert_arena arena;
+  convertArena_Init(&arena);
 
-  const CBLDocument *doc = CBLDatabase_GetDocument(databaseRef->database, FLStr(docID), &err);
+  err.code = 0;
+  const CBLDocument *doc = getCachedDocument(databaseRef->documentCache, databaseRef->database, napiValueToFLString(env, args[1], &arena), &err);
+  convertArena_Free(&arena);
 
   napi_value res;
   if (doc)
@@ -92,11 +199,12 @@ napi_value Database_GetMutableDocument(napi_env env, napi_callback_info info)
     return NULL;
   }
 
-  size_t buffer_size = 128;
-  char docID[buffer_size];
-  napi_get_value_string_utf8(env, args[1], docID, buffer_size, NULL);
+  convert_arena arena;
+  convertArena_Init(&arena);
 
-  CBLDocument *doc = CBLDatabase_GetMutableDocument(databaseRef->database, FLStr(docID), &err);
+  err.code = 0;
+  CBLDocument *doc = CBLDatabase_GetMutableDocument(databaseRef->database, napiValueToFLString(env, args[1], &arena), &err);
+  convertArena_Free(&arena);
 
   napi_value res;
   if (doc)
@@ -139,6 +247,8 @@ napi_value Database_DeleteDocument(napi_env env, napi_callback_info info)
   CBLDocument *doc = docRef->document;
 
   bool didDelete = CBLDatabase_DeleteDocument(databaseRef->database, doc, &err);
+  invalidateCachedDocument(databaseRef->documentCache, doc);
+  countTransactionOp(databaseRef);
 
   if (!didDelete)
   {
@@ -151,158 +261,1633 @@ napi_value Database_DeleteDocument(napi_env env, napi_callback_info info)
   return res;
 }
 
-// CBLDatabase_SaveDocument
-napi_value Database_SaveDocument(napi_env env, napi_callback_info info)
+// How a save resolves a conflict with a revision saved since the document was read
+typedef enum
 {
-  CBLError err;
+  kSaveConflictLastWriteWins, // the document being saved replaces the stored one (default)
+  kSaveConflictFail,          // nothing is saved
+  kSaveConflictMergeShallow,  // top-level properties being saved are set on top of the stored ones
+  kSaveConflictMergeDeep,     // as shallow, but dicts on both sides are merged key by key
+} save_conflict_strategy;
+
+// Sets every property of source on target. Deep merges recurse into dicts present on both sides.
+static void mergeDict(FLMutableDict target, FLDict source, bool deep)
+{
+  FLDictIterator iter;
+  FLDictIterator_Begin(source, &iter);
+  FLValue value;
 
-  napi_value res;
-  napi_get_boolean(env, false, &res);
+  while (NULL != (value = FLDictIterator_GetValue(&iter)))
+  {
+    FLString key = FLDictIterator_GetKeyString(&iter);
+    FLMutableDict child = deep && FLValue_GetType(value) == kFLDict ? FLMutableDict_GetMutableDict(target, key) : NULL;
 
-  size_t argc = 2;
-  napi_value args[2];
-  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+    if (child)
+    {
+      mergeDict(child, FLValue_AsDict(value), deep);
+    }
+    else
+    {
+      FLMutableDict_SetValue(target, key, value);
+    }
 
-  external_database_ref *databaseRef;
-  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
-  if (!databaseRef->isOpen)
-  {
-    napi_throw_error(env, "", "Database is closed");
-    return NULL;
+    FLDictIterator_Next(&iter);
   }
-  if (!databaseRef->isOpen)
+
+  FLDictIterator_End(&iter);
+}
+
+// CBLConflictHandler for the merge strategies, called with the database locked
+static bool MergeConflictHandler(void *context, CBLDocument *documentBeingSaved, const CBLDocument *conflictingDocument)
+{
+  // A conflicting deletion has nothing to merge with
+  if (!conflictingDocument)
   {
-    napi_throw_error(env, "", "Database is closed");
-    return NULL;
+    return true;
   }
 
-  external_document_ref *docRef;
-  CHECK(napi_get_value_external(env, args[1], (void *)&docRef));
-  CBLDocument *doc = docRef->document;
+  FLMutableDict merged = FLDict_MutableCopy(CBLDocument_Properties(conflictingDocument), kFLDefaultCopy);
+  mergeDict(merged, CBLDocument_Properties(documentBeingSaved), *(save_conflict_strategy *)context == kSaveConflictMergeDeep);
+  CBLDocument_SetProperties(documentBeingSaved, merged);
+  FLMutableDict_Release(merged);
 
-  bool didSave = CBLDatabase_SaveDocument(databaseRef->database, doc, &err);
-  napi_get_boolean(env, didSave, &res);
+  return true;
+}
 
-  if (!didSave)
+// Reads { concurrency, merge } save options. Returns false after throwing if they are invalid.
+static bool napiValueToSaveConflictStrategy(napi_env env, napi_value options, save_conflict_strategy *strategy)
+{
+  *strategy = kSaveConflictLastWriteWins;
+
+  napi_valuetype optionsType;
+  CHECK(napi_typeof(env, options, &optionsType));
+
+  if (optionsType != napi_object)
   {
-    throwCBLError(env, err);
+    return true;
   }
 
-  return res;
-}
+  napi_value napiConcurrency;
+  napi_valuetype concurrencyType;
+  CHECK(napi_get_named_property(env, options, "concurrency", &napiConcurrency));
+  CHECK(napi_typeof(env, napiConcurrency, &concurrencyType));
 
-// CBLDocument_Create
-// CBLDocument_CreateWithID
-napi_value Document_Create(napi_env env, napi_callback_info info)
-{
-  size_t argc = 1;
-  napi_value args[1];
-  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  napi_value napiMerge;
+  napi_valuetype mergeType;
+  CHECK(napi_get_named_property(env, options, "merge", &napiMerge));
+  CHECK(napi_typeof(env, napiMerge, &mergeType));
 
-  CBLDocument *doc;
+  if (concurrencyType == napi_string && mergeType != napi_undefined)
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: concurrency and merge cannot be used together");
+    return false;
+  }
 
-  if (argc == 1)
+  if (concurrencyType == napi_string)
   {
-    napi_valuetype valuetype0;
-    CHECK(napi_typeof(env, args[0], &valuetype0));
+    char concurrency[16];
+    CHECK(napi_get_value_string_utf8(env, napiConcurrency, concurrency, sizeof(concurrency), NULL));
 
-    if (valuetype0 != napi_string)
+    if (strcmp(concurrency, "failOnConflict") == 0)
     {
-      napi_throw_type_error(env, NULL, "Wrong arguments");
-      return NULL;
+      *strategy = kSaveConflictFail;
+      return true;
+    }
+    else if (strcmp(concurrency, "lastWriteWins") == 0)
+    {
+      return true;
     }
+  }
+  else if (mergeType == napi_string)
+  {
+    char merge[16];
+    CHECK(napi_get_value_string_utf8(env, napiMerge, merge, sizeof(merge), NULL));
 
-    FLString docID = napiValueToFLString(env, args[0]);
-    doc = CBLDocument_CreateWithID(docID);
+    if (strcmp(merge, "shallow") == 0)
+    {
+      *strategy = kSaveConflictMergeShallow;
+      return true;
+    }
+    else if (strcmp(merge, "deep") == 0)
+    {
+      *strategy = kSaveConflictMergeDeep;
+      return true;
+    }
   }
-  else
+  else if (concurrencyType == napi_undefined && mergeType == napi_undefined)
   {
-    doc = CBLDocument_Create();
+    return true;
+  }
+
+  napi_throw_type_error(env, NULL, "Wrong arguments: concurrency must be 'lastWriteWins' or 'failOnConflict', and merge 'shallow' or 'deep'");
+  return false;
+}
+
+// Saves and returns whether the document was saved, which is false only on conflict. Throws on other errors.
+static napi_value saveDocumentWithStrategy(napi_env env, external_database_ref *databaseRef, CBLDocument *doc, save_conflict_strategy strategy)
+{
+  CBLError err;
+  err.code = 0;
+  bool didSave;
+
+  switch (strategy)
+  {
+  case kSaveConflictFail:
+    didSave = CBLDatabase_SaveDocumentWithConcurrencyControl(databaseRef->database, doc, kCBLConcurrencyControlFailOnConflict, &err);
+    break;
+  case kSaveConflictMergeShallow:
+  case kSaveConflictMergeDeep:
+    didSave = CBLDatabase_SaveDocumentWithConflictHandler(databaseRef->database, doc, MergeConflictHandler, &strategy, &err);
+    break;
+  default:
+    didSave = CBLDatabase_SaveDocument(databaseRef->database, doc, &err);
+    break;
+  }
+
+  invalidateCachedDocument(databaseRef->documentCache, doc);
+  countTransactionOp(databaseRef);
+
+  // A conflict is an expected outcome of failOnConflict, not an error
+  if (!didSave && !(err.domain == kCBLDomain && err.code == kCBLErrorConflict))
+  {
+    throwCBLError(env, err);
+    return NULL;
   }
 
   napi_value res;
-  external_document_ref *documentRef = createExternalDocumentRef(doc);
-  CHECK(napi_create_external(env, documentRef, finalize_document_external, NULL, &res));
+  CHECK(napi_get_boolean(env, didSave, &res));
 
   return res;
 }
 
-// CBLDocument_CreateJSON
-napi_value Document_CreateJSON(napi_env env, napi_callback_info info)
+// CBLDatabase_SaveDocument
+// CBLDatabase_SaveDocumentWithConcurrencyControl
+// CBLDatabase_SaveDocumentWithConflictHandler
+napi_value Database_SaveDocument(napi_env env, napi_callback_info info)
 {
-  size_t argc = 1;
-  napi_value args[1];
+  size_t argc = 3;
+  napi_value args[3];
   CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
 
-  external_document_ref *docRef;
-  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
-  CBLDocument *doc = docRef->document;
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
 
-  FLSliceResult docJson = CBLDocument_CreateJSON(doc);
-  napi_value json;
-  CHECK(napi_create_string_utf8(env, docJson.buf, docJson.size, &json));
+  save_conflict_strategy strategy;
+  if (!napiValueToSaveConflictStrategy(env, args[2], &strategy))
+  {
+    return NULL;
+  }
 
-  FLSliceResult_Release(docJson);
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[1], (void *)&docRef));
+  CBLDocument *doc = docRef->document;
 
-  return json;
+  return saveDocumentWithStrategy(env, databaseRef, doc, strategy);
 }
 
-// CBLDocument_Properties
-napi_value Document_Properties(napi_env env, napi_callback_info info)
+// CBLDocument_CreateWithID, CBLDocument_SetProperties and CBLDatabase_SaveDocument in one call, without a document
+// ref. A stored document with the same ID is replaced, or merged with or kept as the options say.
+napi_value Database_PutDocument(napi_env env, napi_callback_info info)
 {
-  size_t argc = 1;
-  napi_value args[1];
+  size_t argc = 4;
+  napi_value args[4];
   CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
 
-  external_document_ref *docRef;
-  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
-  CBLDocument *doc = docRef->document;
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
 
-  FLDict properties = CBLDocument_Properties(doc);
-  napi_value res = flDictToNapiValue(env, properties);
+  save_conflict_strategy strategy;
+  if (!napiValueToSaveConflictStrategy(env, args[3], &strategy))
+  {
+    return NULL;
+  }
+
+  FLMutableDict value = napiValueToFLDict(env, args[2]);
+
+  if (!value)
+  {
+    napi_throw_error(env, "", "Error encoding document properties");
+    return NULL;
+  }
+
+  convert_arena arena;
+  convertArena_Init(&arena);
+  CBLDocument *doc = CBLDocument_CreateWithID(napiValueToFLString(env, args[1], &arena));
+  convertArena_Free(&arena);
+
+  CBLDocument_SetProperties(doc, value);
+  FLMutableDict_Release(value);
+
+  napi_value res = saveDocumentWithStrategy(env, databaseRef, doc, strategy);
+  CBLDocument_Release(doc);
 
   return res;
 }
 
-// CBLDocument_SetJSON
-napi_value Document_SetJSON(napi_env env, napi_callback_info info)
+// CBLDatabase_GetDocument and CBLDocument_Properties in one call, without a document ref. Read through the document
+// cache when it is enabled, so properties may be frozen.
+napi_value Database_GetDocumentPropertiesByID(napi_env env, napi_callback_info info)
 {
-
   size_t argc = 2;
   napi_value args[2];
   CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
 
-  external_document_ref *docRef;
-  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
-  CBLDocument *doc = docRef->document;
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
 
-  size_t str_size;
-  napi_get_value_string_utf8(env, args[1], NULL, 0, &str_size);
-  char *json;
-  json = (char *)calloc(str_size + 1, sizeof(char));
-  str_size = str_size + 1;
-  napi_get_value_string_utf8(env, args[1], json, str_size, NULL);
+  convert_arena arena;
+  convertArena_Init(&arena);
+  FLString docID = napiValueToFLString(env, args[1], &arena);
 
   CBLError err;
-  bool didSetJson = CBLDocument_SetJSON(doc, FLStr(json), &err);
+  err.code = 0;
+  napi_value res = NULL;
 
-  if (!didSetJson)
+  if (databaseRef->documentCache)
   {
-    napi_throw_error(env, "", "Set JSON failed");
+    res = documentCache_GetProperties(env, databaseRef->documentCache, databaseRef->database, docID, &err);
   }
+  else
+  {
+    const CBLDocument *doc = CBLDatabase_GetDocument(databaseRef->database, docID, &err);
 
-  napi_value res;
-  CHECK(napi_get_boolean(env, didSetJson, &res));
+    if (doc)
+    {
+      res = flDictToNapiValue(env, CBLDocument_Properties(doc));
+      CBLDocument_Release(doc);
+    }
+    else if (err.code == 0)
+    {
+      CHECK(napi_get_null(env, &res));
+    }
+  }
+
+  convertArena_Free(&arena);
+
+  if (!res)
+  {
+    throwCBLError(env, err);
+  }
 
   return res;
 }
 
-// CBLDocument_SetProperties
-napi_value Document_SetProperties(napi_env env, napi_callback_info info)
+// Database and document handles are retained for the lifetime of the work, so the JS refs can be closed or collected
+// while it runs. A document being saved or deleted must not be modified until the Promise settles.
+typedef struct DocumentWork
 {
-  size_t argc = 2;
-  napi_value args[2];
-  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  async_work_data async;
+  CBLDatabase *database;
+  document_cache *documentCache;
+  CBLDocument *document;
+  FLSliceResult docID;
+  bool isMutable;
+} document_work;
+
+static document_work *createDocumentWork(external_database_ref *databaseRef)
+{
+  document_work *work = calloc(1, sizeof(*work));
+  work->database = CBLDatabase_Retain(databaseRef->database);
+  work->documentCache = databaseRef->documentCache ? documentCache_Retain(databaseRef->documentCache) : NULL;
+
+  return work;
+}
+
+static void freeDocumentWork(napi_env env, document_work *work)
+{
+  CBLDatabase_Release(work->database);
+
+  if (work->documentCache)
+  {
+    documentCache_Release(env, work->documentCache);
+  }
+
+  if (work->document)
+  {
+    CBLDocument_Release(work->document);
+  }
+
+  FLSliceResult_Release(work->docID);
+  free(work);
+}
+
+static void GetDocumentAsync_Execute(napi_env env, void *data)
+{
+  document_work *work = (document_work *)data;
+  FLString docID = FLSliceResult_AsSlice(work->docID);
+
+  work->document = work->isMutable
+                       ? CBLDatabase_GetMutableDocument(work->database, docID, &work->async.err)
+                       : (CBLDocument *)getCachedDocument(work->documentCache, work->database, docID, &work->async.err);
+}
+
+static void GetDocumentAsync_Complete(napi_env env, napi_status status, void *data)
+{
+  document_work *work = (document_work *)data;
+
+  napi_value res;
+  if (work->document)
+  {
+    // The external takes over the reference returned by CBL
+    external_document_ref *documentRef = createExternalDocumentRef(work->document);
+    work->document = NULL;
+    CHECK(napi_create_external(env, documentRef, finalize_document_external, NULL, &res));
+  }
+  else
+  {
+    CHECK(napi_get_null(env, &res));
+  }
+
+  finishAsyncWork(env, &work->async, res);
+  freeDocumentWork(env, work);
+}
+
+static napi_value getDocumentAsync(napi_env env, napi_callback_info info, bool isMutable)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    return createRejectedPromise(env, "Database is closed");
+  }
+
+  document_work *work = createDocumentWork(databaseRef);
+  work->isMutable = isMutable;
+
+  convert_arena arena;
+  convertArena_Init(&arena);
+  work->docID = FLSlice_Copy(napiValueToFLString(env, args[1], &arena));
+  convertArena_Free(&arena);
+
+  return queueAsyncWork(env, "couchbase-lite get document", GetDocumentAsync_Execute, GetDocumentAsync_Complete, &work->async);
+}
+
+// CBLDatabase_GetDocument, off the JS thread
+napi_value Database_GetDocumentAsync(napi_env env, napi_callback_info info)
+{
+  return getDocumentAsync(env, info, false);
+}
+
+// CBLDatabase_GetMutableDocument, off the JS thread
+napi_value Database_GetMutableDocumentAsync(napi_env env, napi_callback_info info)
+{
+  return getDocumentAsync(env, info, true);
+}
+
+static void SaveDocumentAsync_Execute(napi_env env, void *data)
+{
+  document_work *work = (document_work *)data;
+
+  CBLDatabase_SaveDocument(work->database, work->document, &work->async.err);
+  invalidateCachedDocument(work->documentCache, work->document);
+}
+
+static void DeleteDocumentAsync_Execute(napi_env env, void *data)
+{
+  document_work *work = (document_work *)data;
+
+  CBLDatabase_DeleteDocument(work->database, work->document, &work->async.err);
+  invalidateCachedDocument(work->documentCache, work->document);
+}
+
+static void WriteDocumentAsync_Complete(napi_env env, napi_status status, void *data)
+{
+  document_work *work = (document_work *)data;
+
+  napi_value res;
+  CHECK(napi_get_boolean(env, true, &res));
+
+  finishAsyncWork(env, &work->async, res);
+  freeDocumentWork(env, work);
+}
+
+static napi_value writeDocumentAsync(napi_env env, napi_callback_info info, const char *name, napi_async_execute_callback execute)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    return createRejectedPromise(env, "Database is closed");
+  }
+
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[1], (void *)&docRef));
+
+  document_work *work = createDocumentWork(databaseRef);
+  work->document = (CBLDocument *)CBLDocument_Retain(docRef->document);
+
+  return queueAsyncWork(env, name, execute, WriteDocumentAsync_Complete, &work->async);
+}
+
+// CBLDatabase_SaveDocument, off the JS thread
+napi_value Database_SaveDocumentAsync(napi_env env, napi_callback_info info)
+{
+  return writeDocumentAsync(env, info, "couchbase-lite save document", SaveDocumentAsync_Execute);
+}
+
+// CBLDatabase_DeleteDocument, off the JS thread
+napi_value Database_DeleteDocumentAsync(napi_env env, napi_callback_info info)
+{
+  return writeDocumentAsync(env, info, "couchbase-lite delete document", DeleteDocumentAsync_Execute);
+}
+
+// Documents looked up by ID in a single native call. The IDs are read into the batch's own arena, so a batch can be
+// handed to a worker thread as-is.
+typedef struct DocumentBatch
+{
+  convert_arena arena;
+  FLString *ids;
+  const CBLDocument **documents;
+  uint32_t count;
+  bool asProperties;
+} document_batch;
+
+static bool initDocumentBatch(napi_env env, document_batch *batch, napi_value ids, napi_value options)
+{
+  convertArena_Init(&batch->arena);
+  batch->ids = NULL;
+  batch->documents = NULL;
+  batch->count = 0;
+  batch->asProperties = false;
+
+  if (!isArray(env, ids))
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: document IDs must be an array");
+    return false;
+  }
+
+  CHECK(napi_get_array_length(env, ids, &batch->count));
+  batch->ids = malloc(batch->count * sizeof(*batch->ids));
+  batch->documents = calloc(batch->count, sizeof(*batch->documents));
+
+  for (uint32_t i = 0; i < batch->count; i++)
+  {
+    napi_value id;
+    CHECK(napi_get_element(env, ids, i, &id));
+
+    napi_valuetype type;
+    CHECK(napi_typeof(env, id, &type));
+
+    if (type != napi_string)
+    {
+      napi_throw_type_error(env, NULL, "Wrong arguments: document IDs must be strings");
+      return false;
+    }
+
+    batch->ids[i] = napiValueToFLString(env, id, &batch->arena);
+  }
+
+  // Options are optional for callers that only need the IDs
+  napi_valuetype optionsType = napi_undefined;
+  if (options)
+  {
+    CHECK(napi_typeof(env, options, &optionsType));
+  }
+
+  if (optionsType == napi_object)
+  {
+    return napiOptionToCBool(env, options, "properties", &batch->asProperties);
+  }
+
+  return true;
+}
+
+static void freeDocumentBatch(document_batch *batch)
+{
+  for (uint32_t i = 0; batch->documents && i < batch->count; i++)
+  {
+    if (batch->documents[i])
+    {
+      CBLDocument_Release(batch->documents[i]);
+    }
+  }
+
+  free(batch->documents);
+  free(batch->ids);
+  convertArena_Free(&batch->arena);
+}
+
+// Stops at the first lookup that fails for a reason other than the document not existing
+static bool fetchDocumentBatch(document_cache *cache, CBLDatabase *database, document_batch *batch, CBLError *err)
+{
+  for (uint32_t i = 0; i < batch->count; i++)
+  {
+    err->code = 0;
+    batch->documents[i] = getCachedDocument(cache, database, batch->ids[i], err);
+
+    if (!batch->documents[i] && err->code != 0)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Moves the fetched documents into a JS array of refs or properties, with null for missing documents
+static napi_value documentBatchToNapiArray(napi_env env, document_batch *batch)
+{
+  napi_value res;
+  CHECK(napi_create_array_with_length(env, batch->count, &res));
+
+  for (uint32_t i = 0; i < batch->count; i++)
+  {
+    const CBLDocument *doc = batch->documents[i];
+
+    napi_value value;
+    if (!doc)
+    {
+      CHECK(napi_get_null(env, &value));
+    }
+    else if (batch->asProperties)
+    {
+      value = flDictToNapiValue(env, CBLDocument_Properties(doc));
+    }
+    else
+    {
+      external_document_ref *documentRef = createExternalDocumentRef((CBLDocument *)doc);
+      batch->documents[i] = NULL;
+      CHECK(napi_create_external(env, documentRef, finalize_document_external, NULL, &value));
+    }
+
+    CHECK(napi_set_element(env, res, i, value));
+  }
+
+  return res;
+}
+
+// Looks properties up in the cache one by one, so every hit is returned without converting the document again
+static napi_value cachedPropertiesToNapiArray(napi_env env, document_cache *cache, CBLDatabase *database, document_batch *batch, CBLError *err)
+{
+  napi_value res;
+  CHECK(napi_create_array_with_length(env, batch->count, &res));
+
+  for (uint32_t i = 0; i < batch->count; i++)
+  {
+    err->code = 0;
+    napi_value value = documentCache_GetProperties(env, cache, database, batch->ids[i], err);
+
+    if (!value)
+    {
+      return NULL;
+    }
+
+    CHECK(napi_set_element(env, res, i, value));
+  }
+
+  return res;
+}
+
+// CBLDatabase_GetDocument, for many IDs at once
+napi_value Database_GetDocuments(napi_env env, napi_callback_info info)
+{
+  size_t argc = 3;
+  napi_value args[3];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
+
+  document_batch batch;
+  napi_value res = NULL;
+
+  if (initDocumentBatch(env, &batch, args[1], args[2]))
+  {
+    CBLError err;
+    document_cache *cache = databaseRef->documentCache;
+
+    if (batch.asProperties && cache && cache->cacheProperties)
+    {
+      res = cachedPropertiesToNapiArray(env, cache, databaseRef->database, &batch, &err);
+    }
+    else if (fetchDocumentBatch(cache, databaseRef->database, &batch, &err))
+    {
+      res = documentBatchToNapiArray(env, &batch);
+    }
+
+    if (!res)
+    {
+      throwCBLError(env, err);
+    }
+  }
+
+  freeDocumentBatch(&batch);
+
+  return res;
+}
+
+typedef struct DocumentsWork
+{
+  async_work_data async;
+  CBLDatabase *database;
+  document_cache *documentCache;
+  document_batch batch;
+} documents_work;
+
+static void GetDocumentsAsync_Execute(napi_env env, void *data)
+{
+  documents_work *work = (documents_work *)data;
+
+  fetchDocumentBatch(work->documentCache, work->database, &work->batch, &work->async.err);
+}
+
+static void GetDocumentsAsync_Complete(napi_env env, napi_status status, void *data)
+{
+  documents_work *work = (documents_work *)data;
+
+  napi_value res = NULL;
+  if (work->async.err.code == 0)
+  {
+    res = documentBatchToNapiArray(env, &work->batch);
+  }
+
+  finishAsyncWork(env, &work->async, res);
+
+  CBLDatabase_Release(work->database);
+  if (work->documentCache)
+  {
+    documentCache_Release(env, work->documentCache);
+  }
+  freeDocumentBatch(&work->batch);
+  free(work);
+}
+
+// CBLDatabase_GetDocument for many IDs at once, off the JS thread
+napi_value Database_GetDocumentsAsync(napi_env env, napi_callback_info info)
+{
+  size_t argc = 3;
+  napi_value args[3];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    return createRejectedPromise(env, "Database is closed");
+  }
+
+  documents_work *work = malloc(sizeof(*work));
+
+  if (!initDocumentBatch(env, &work->batch, args[1], args[2]))
+  {
+    freeDocumentBatch(&work->batch);
+    free(work);
+    return rejectPendingException(env);
+  }
+
+  work->database = CBLDatabase_Retain(databaseRef->database);
+  work->documentCache = databaseRef->documentCache ? documentCache_Retain(databaseRef->documentCache) : NULL;
+
+  return queueAsyncWork(env, "couchbase-lite get documents", GetDocumentsAsync_Execute, GetDocumentsAsync_Complete, &work->async);
+}
+
+#define SAVE_DOCUMENTS_DEFAULT_BATCH_SIZE 1000
+
+static napi_value createSaveDocumentResult(napi_env env, FLString docID, bool saved, napi_value error)
+{
+  napi_value res;
+  CHECK(napi_create_object(env, &res));
+
+  // Entries rejected before a document was created may not have an ID
+  napi_value id;
+  if (docID.buf)
+  {
+    CHECK(napi_create_string_utf8(env, docID.buf, docID.size, &id));
+  }
+  else
+  {
+    CHECK(napi_get_null(env, &id));
+  }
+  CHECK(napi_set_named_property(env, res, "id", id));
+
+  napi_value napiSaved;
+  CHECK(napi_get_boolean(env, saved, &napiSaved));
+  CHECK(napi_set_named_property(env, res, "saved", napiSaved));
+
+  if (error)
+  {
+    CHECK(napi_set_named_property(env, res, "error", error));
+  }
+
+  return res;
+}
+
+// Converts and saves a single { id, properties } entry, returning its { id, saved, error? } result
+static napi_value saveDocumentEntry(napi_env env, external_database_ref *databaseRef, napi_value entry, FLEncoder enc, convert_arena *arena)
+{
+  napi_valuetype type;
+  CHECK(napi_typeof(env, entry, &type));
+
+  napi_value napiID = NULL;
+  napi_value properties = NULL;
+  napi_valuetype idType = napi_undefined;
+  napi_valuetype propertiesType = napi_undefined;
+
+  if (type == napi_object)
+  {
+    CHECK(napi_get_named_property(env, entry, "id", &napiID));
+    CHECK(napi_typeof(env, napiID, &idType));
+    CHECK(napi_get_named_property(env, entry, "properties", &properties));
+    CHECK(napi_typeof(env, properties, &propertiesType));
+  }
+
+  FLString docID = idType == napi_string ? napiValueToFLString(env, napiID, arena) : kFLSliceNull;
+
+  if (propertiesType != napi_object || (idType != napi_string && idType != napi_undefined))
+  {
+    return createSaveDocumentResult(env, docID, false, createError(env, "Documents must have an optional string id and a properties object"));
+  }
+
+  FLMutableDict value = napiValueToFLDictWithEncoder(env, enc, properties, arena);
+
+  if (!value)
+  {
+    FLEncoder_Reset(enc);
+
+    return createSaveDocumentResult(env, docID, false, createError(env, "Error encoding document properties"));
+  }
+
+  CBLDocument *doc = docID.buf ? CBLDocument_CreateWithID(docID) : CBLDocument_Create();
+  CBLDocument_SetProperties(doc, value);
+  FLMutableDict_Release(value);
+
+  CBLError err;
+  bool didSave = CBLDatabase_SaveDocument(databaseRef->database, doc, &err);
+  invalidateCachedDocument(databaseRef->documentCache, doc);
+  countTransactionOp(databaseRef);
+  napi_value res = createSaveDocumentResult(env, CBLDocument_ID(doc), didSave, didSave ? NULL : createCBLError(env, err));
+
+  CBLDocument_Release(doc);
+
+  return res;
+}
+
+// CBLDatabase_SaveDocument for many documents, grouped into transactions
+napi_value Database_SaveDocuments(napi_env env, napi_callback_info info)
+{
+  size_t argc = 3;
+  napi_value args[3];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
+
+  if (!isArray(env, args[1]))
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: documents must be an array");
+    return NULL;
+  }
+
+  uint32_t batchSize = SAVE_DOCUMENTS_DEFAULT_BATCH_SIZE;
+  napi_valuetype optionsType;
+  CHECK(napi_typeof(env, args[2], &optionsType));
+
+  if (optionsType == napi_object && !napiOptionToPositiveUInt32(env, args[2], "batchSize", &batchSize))
+  {
+    return NULL;
+  }
+
+  uint32_t count;
+  CHECK(napi_get_array_length(env, args[1], &count));
+
+  napi_value res;
+  CHECK(napi_create_array_with_length(env, count, &res));
+
+  // One encoder and arena are reused for every document
+  FLEncoder enc = FLEncoder_New();
+  convert_arena arena;
+  convertArena_Init(&arena);
+
+  CBLError err;
+  bool failed = false;
+
+  for (uint32_t i = 0; i < count && !failed; i++)
+  {
+    if (i % batchSize == 0 && !CBLDatabase_BeginTransaction(databaseRef->database, &err))
+    {
+      failed = true;
+      break;
+    }
+
+    // Only the result outlives the iteration
+    napi_handle_scope scope;
+    CHECK(napi_open_handle_scope(env, &scope));
+
+    napi_value entry;
+    CHECK(napi_get_element(env, args[1], i, &entry));
+
+    convert_arena_mark mark = convertArena_Mark(&arena);
+    CHECK(napi_set_element(env, res, i, saveDocumentEntry(env, databaseRef, entry, enc, &arena)));
+    convertArena_Rewind(&arena, mark);
+
+    CHECK(napi_close_handle_scope(env, scope));
+
+    if ((i + 1) % batchSize == 0 || i + 1 == count)
+    {
+      failed = !CBLDatabase_EndTransaction(databaseRef->database, true, &err);
+    }
+  }
+
+  FLEncoder_Free(enc);
+  convertArena_Free(&arena);
+
+  if (failed)
+  {
+    throwCBLError(env, err);
+    return NULL;
+  }
+
+  return res;
+}
+
+// CBLDocument_Create
+// CBLDocument_CreateWithID
+napi_value Document_Create(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  CBLDocument *doc;
+  convert_arena arena;
+  convertArena_Init(&arena);
+
+  if (argc == 1)
+  {
+    napi_valuetype valuetype0;
+    CHECK(napi_typeof(env, args[0], &valuetype0));
+
+    if (valuetype0 != napi_string)
+    {
+      napi_throw_type_error(env, NULL, "Wrong arguments");
+      return NULL;
+    }
+
+    FLString docID = napiValueToFLString(env, args[0], &arena);
+    doc = CBLDocument_CreateWithID(docID);
+  }
+  else
+  {
+    doc = CBLDocument_Create();
+  }
+
+  convertArena_Free(&arena);
+
+  napi_value res;
+  external_document_ref *documentRef = createExternalDocumentRef(doc);
+  CHECK(napi_create_external(env, documentRef, finalize_document_external, NULL, &res));
+
+  return res;
+}
+
+// CBLDocument_CreateJSON
+napi_value Document_CreateJSON(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
+  CBLDocument *doc = docRef->document;
+
+  FLSliceResult docJson = CBLDocument_CreateJSON(doc);
+  napi_value json;
+  CHECK(napi_create_string_utf8(env, docJson.buf, docJson.size, &json));
+
+  FLSliceResult_Release(docJson);
+
+  return json;
+}
+
+// CBLDocument_Properties
+napi_value Document_Properties(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
+  CBLDocument *doc = docRef->document;
+
+  FLDict properties = CBLDocument_Properties(doc);
+  napi_value res = flDictToNapiValue(env, properties);
+
+  return res;
+}
+
+// CBLDocument_Properties, encoded as standalone Fleece
+napi_value Document_Fleece(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
+  CBLDocument *doc = docRef->document;
+
+  // Re-encoding without shared keys writes every key as a string, so the result can be decoded on its own
+  FLEncoder enc = FLEncoder_New();
+  FLEncoder_WriteValue(enc, (FLValue)CBLDocument_Properties(doc));
+
+  FLError err;
+  FLSliceResult data = FLEncoder_Finish(enc, &err);
+  FLEncoder_Free(enc);
+
+  if (!data.buf)
+  {
+    napi_throw_error(env, "", "Error encoding document properties");
+    return NULL;
+  }
+
+  return flSliceResultToNapiArrayBuffer(env, data);
+}
+
+// Lets getDocumentFields tell compiled key paths apart from any other external
+static const napi_type_tag keyPathRefTypeTag = {0x2d6f91c4a8e35b07, 0xb31e5f0c7a94d268};
+
+static void finalize_key_path_external(napi_env env, void *data, void *hint)
+{
+  external_key_path_ref *keyPathRef = (external_key_path_ref *)data;
+
+  FLKeyPath_Free(keyPathRef->keyPath);
+  free(data);
+}
+
+static FLKeyPath compileKeyPath(napi_env env, napi_value path)
+{
+  convert_arena arena;
+  convertArena_Init(&arena);
+
+  FLError err;
+  FLString specifier = napiValueToFLString(env, path, &arena);
+  FLKeyPath keyPath = FLKeyPath_New(specifier, &err);
+
+  if (!keyPath)
+  {
+    char msg[specifier.size + 32];
+    snprintf(msg, sizeof(msg), "Invalid key path: %.*s", (int)specifier.size, (const char *)specifier.buf);
+    napi_throw_error(env, "", msg);
+  }
+
+  convertArena_Free(&arena);
+
+  return keyPath;
+}
+
+// FLKeyPath_New
+napi_value KeyPath_Compile(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  napi_valuetype type;
+  CHECK(napi_typeof(env, args[0], &type));
+
+  if (type != napi_string)
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: key path must be a string");
+    return NULL;
+  }
+
+  FLKeyPath keyPath = compileKeyPath(env, args[0]);
+
+  if (!keyPath)
+  {
+    return NULL;
+  }
+
+  napi_value res;
+  CHECK(napi_create_external(env, createExternalKeyPathRef(keyPath), finalize_key_path_external, NULL, &res));
+  CHECK(napi_type_tag_object(env, res, &keyPathRefTypeTag));
+
+  return res;
+}
+
+// FLKeyPath_Eval against CBLDocument_Properties, for several paths at once. Only the matched values are converted.
+napi_value Document_Fields(napi_env env, napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
+  CBLDocument *doc = docRef->document;
+
+  if (!isArray(env, args[1]))
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: key paths must be an array");
+    return NULL;
+  }
+
+  FLValue properties = (FLValue)CBLDocument_Properties(doc);
+
+  uint32_t count;
+  CHECK(napi_get_array_length(env, args[1], &count));
+
+  napi_value res;
+  CHECK(napi_create_array_with_length(env, count, &res));
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    napi_value path;
+    CHECK(napi_get_element(env, args[1], i, &path));
+
+    napi_valuetype type;
+    CHECK(napi_typeof(env, path, &type));
+
+    FLKeyPath keyPath = NULL;
+    bool isCompiled = false;
+
+    if (type == napi_string)
+    {
+      keyPath = compileKeyPath(env, path);
+
+      if (!keyPath)
+      {
+        return NULL;
+      }
+    }
+    else if (type == napi_external)
+    {
+      CHECK(napi_check_object_type_tag(env, path, &keyPathRefTypeTag, &isCompiled));
+    }
+
+    if (isCompiled)
+    {
+      external_key_path_ref *keyPathRef;
+      CHECK(napi_get_value_external(env, path, (void *)&keyPathRef));
+      keyPath = keyPathRef->keyPath;
+    }
+    else if (!keyPath)
+    {
+      napi_throw_type_error(env, NULL, "Wrong arguments: key paths must be strings or compiled key paths");
+      return NULL;
+    }
+
+    FLValue value = FLKeyPath_Eval(keyPath, properties);
+
+    napi_value napiValue;
+    if (value)
+    {
+      napiValue = flValueToNapiValue(env, value);
+    }
+    else
+    {
+      CHECK(napi_get_undefined(env, &napiValue));
+    }
+
+    CHECK(napi_set_element(env, res, i, napiValue));
+
+    if (!isCompiled)
+    {
+      FLKeyPath_Free(keyPath);
+    }
+  }
+
+  return res;
+}
+
+// How many times patchAndSave re-reads and re-patches a document that was changed by another writer meanwhile
+#define PATCH_AND_SAVE_MAX_ATTEMPTS 5
+
+#define PATCH_ERROR_SIZE 256
+
+// A dict with a single '$'-prefixed key is an operation rather than a value to merge
+static FLString patchOperation(FLValue value, FLValue *operand)
+{
+  FLDict dict = FLValue_AsDict(value);
+
+  if (!dict || FLDict_Count(dict) != 1)
+  {
+    return kFLSliceNull;
+  }
+
+  FLDictIterator iter;
+  FLDictIterator_Begin(dict, &iter);
+  FLString key = FLDictIterator_GetKeyString(&iter);
+  *operand = FLDictIterator_GetValue(&iter);
+  FLDictIterator_End(&iter);
+
+  return key.size > 0 && ((const char *)key.buf)[0] == '$' ? key : kFLSliceNull;
+}
+
+static bool applyPatchOperation(FLMutableDict target, FLString key, FLString op, FLValue operand, char *error)
+{
+  FLValue current = FLDict_Get((FLDict)target, key);
+
+  if (FLSlice_Equal(op, FLSTR("$remove")))
+  {
+    FLMutableDict_Remove(target, key);
+  }
+  else if (FLSlice_Equal(op, FLSTR("$increment")))
+  {
+    if (FLValue_GetType(operand) != kFLNumber || (current && FLValue_GetType(current) != kFLNumber))
+    {
+      snprintf(error, PATCH_ERROR_SIZE, "Cannot $increment '%.*s': not a number", (int)key.size, (const char *)key.buf);
+      return false;
+    }
+
+    // A missing field counts as 0
+    if ((!current || FLValue_IsInteger(current)) && FLValue_IsInteger(operand))
+    {
+      FLMutableDict_SetInt(target, key, FLValue_AsInt(current) + FLValue_AsInt(operand));
+    }
+    else
+    {
+      FLMutableDict_SetDouble(target, key, FLValue_AsDouble(current) + FLValue_AsDouble(operand));
+    }
+  }
+  else if (FLSlice_Equal(op, FLSTR("$append")))
+  {
+    FLMutableArray array = FLMutableDict_GetMutableArray(target, key);
+
+    if (!array && current)
+    {
+      snprintf(error, PATCH_ERROR_SIZE, "Cannot $append to '%.*s': not an array", (int)key.size, (const char *)key.buf);
+      return false;
+    }
+
+    if (!array)
+    {
+      array = FLMutableArray_New();
+      FLMutableDict_SetArray(target, key, array);
+      FLMutableArray_Release(array);
+    }
+
+    // Arrays are concatenated, anything else is appended as a single item
+    FLArray items = FLValue_AsArray(operand);
+
+    if (items)
+    {
+      FLArrayIterator iter;
+      FLArrayIterator_Begin(items, &iter);
+      FLValue item;
+
+      while (NULL != (item = FLArrayIterator_GetValue(&iter)))
+      {
+        FLMutableArray_AppendValue(array, item);
+        FLArrayIterator_Next(&iter);
+      }
+    }
+    else
+    {
+      FLMutableArray_AppendValue(array, operand);
+    }
+  }
+  else
+  {
+    snprintf(error, PATCH_ERROR_SIZE, "Unknown patch operation '%.*s'", (int)op.size, (const char *)op.buf);
+    return false;
+  }
+
+  return true;
+}
+
+// Applies a JSON merge patch (RFC 7386) in place: null removes a key, dicts are merged recursively and anything else
+// replaces the current value. Only the patched paths are touched; the rest of the document stays encoded.
+static bool applyPatch(FLMutableDict target, FLDict patch, char *error)
+{
+  FLDictIterator iter;
+  FLDictIterator_Begin(patch, &iter);
+  FLValue value;
+  bool ok = true;
+
+  while (ok && NULL != (value = FLDictIterator_GetValue(&iter)))
+  {
+    FLString key = FLDictIterator_GetKeyString(&iter);
+    FLValue operand = NULL;
+    FLString op = patchOperation(value, &operand);
+
+    if (op.buf)
+    {
+      ok = applyPatchOperation(target, key, op, operand, error);
+    }
+    else if (FLValue_GetType(value) == kFLNull)
+    {
+      FLMutableDict_Remove(target, key);
+    }
+    else if (FLValue_GetType(value) == kFLDict)
+    {
+      FLMutableDict child = FLMutableDict_GetMutableDict(target, key);
+
+      if (!child)
+      {
+        child = FLMutableDict_New();
+        FLMutableDict_SetDict(target, key, child);
+        FLMutableDict_Release(child);
+      }
+
+      ok = applyPatch(child, FLValue_AsDict(value), error);
+    }
+    else
+    {
+      FLMutableDict_SetValue(target, key, value);
+    }
+
+    FLDictIterator_Next(&iter);
+  }
+
+  FLDictIterator_End(&iter);
+
+  return ok;
+}
+
+static FLDoc napiValueToPatch(napi_env env, napi_value patch)
+{
+  napi_valuetype type;
+  CHECK(napi_typeof(env, patch, &type));
+
+  if (type != napi_object || isArray(env, patch))
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: patch must be an object");
+    return NULL;
+  }
+
+  FLDoc doc = napiObjectToFLDoc(env, patch);
+
+  if (!doc)
+  {
+    napi_throw_error(env, "", "Error encoding patch");
+  }
+
+  return doc;
+}
+
+// CBLDocument_MutableProperties, patched in place
+napi_value Document_Patch(napi_env env, napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
+  CBLDocument *doc = docRef->document;
+
+  FLDoc patch = napiValueToPatch(env, args[1]);
+
+  if (!patch)
+  {
+    return NULL;
+  }
+
+  char error[PATCH_ERROR_SIZE];
+  bool didPatch = applyPatch(CBLDocument_MutableProperties(doc), FLValue_AsDict(FLDoc_GetRoot(patch)), error);
+  FLDoc_Release(patch);
+
+  if (!didPatch)
+  {
+    napi_throw_error(env, "", error);
+    return NULL;
+  }
+
+  napi_value res;
+  CHECK(napi_get_boolean(env, true, &res));
+
+  return res;
+}
+
+// CBLDatabase_GetMutableDocument, patched in place and saved. A missing document is created from the patch.
+napi_value Database_PatchAndSave(napi_env env, napi_callback_info info)
+{
+  size_t argc = 3;
+  napi_value args[3];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
+
+  FLDoc patch = napiValueToPatch(env, args[2]);
+
+  if (!patch)
+  {
+    return NULL;
+  }
+
+  convert_arena arena;
+  convertArena_Init(&arena);
+  FLString docID = napiValueToFLString(env, args[1], &arena);
+
+  CBLError err;
+  char error[PATCH_ERROR_SIZE];
+  bool didPatch = true;
+  bool didSave = false;
+
+  // Saving fails on conflict rather than overwriting a concurrent write, and the patch is re-applied to the new
+  // revision, so increments and appends are never lost
+  for (int attempt = 0; attempt < PATCH_AND_SAVE_MAX_ATTEMPTS && didPatch && !didSave; attempt++)
+  {
+    err.code = 0;
+    CBLDocument *doc = CBLDatabase_GetMutableDocument(databaseRef->database, docID, &err);
+
+    if (!doc && err.code != 0)
+    {
+      break;
+    }
+
+    if (!doc)
+    {
+      doc = CBLDocument_CreateWithID(docID);
+    }
+
+    didPatch = applyPatch(CBLDocument_MutableProperties(doc), FLValue_AsDict(FLDoc_GetRoot(patch)), error);
+
+    if (didPatch)
+    {
+      didSave = CBLDatabase_SaveDocumentWithConcurrencyControl(databaseRef->database, doc, kCBLConcurrencyControlFailOnConflict, &err);
+      invalidateCachedDocument(databaseRef->documentCache, doc);
+      countTransactionOp(databaseRef);
+    }
+
+    CBLDocument_Release(doc);
+
+    if (!didSave && !(err.domain == kCBLDomain && err.code == kCBLErrorConflict))
+    {
+      break;
+    }
+  }
+
+  convertArena_Free(&arena);
+  FLDoc_Release(patch);
+
+  if (!didPatch)
+  {
+    napi_throw_error(env, "", error);
+    return NULL;
+  }
+
+  if (!didSave)
+  {
+    throwCBLError(env, err);
+    return NULL;
+  }
+
+  napi_value res;
+  CHECK(napi_get_boolean(env, true, &res));
+
+  return res;
+}
+
+// CBLDatabase_SetDocumentExpiration. The expiration is a Date or milliseconds since the epoch; null clears it.
+napi_value Database_SetDocumentExpiration(napi_env env, napi_callback_info info)
+{
+  size_t argc = 3;
+  napi_value args[3];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
+
+  napi_valuetype expirationType;
+  CHECK(napi_typeof(env, args[2], &expirationType));
+
+  bool isDate;
+  CHECK(napi_is_date(env, args[2], &isDate));
+
+  double expiration = 0;
+
+  if (isDate)
+  {
+    CHECK(napi_get_date_value(env, args[2], &expiration));
+  }
+  else if (expirationType == napi_number)
+  {
+    expiration = napiValueToCDouble(env, args[2]);
+  }
+  else if (expirationType != napi_null && expirationType != napi_undefined)
+  {
+    napi_throw_type_error(env, NULL, "Wrong arguments: expiration must be a Date, a timestamp or null");
+    return NULL;
+  }
+
+  // (double)INT64_MAX rounds up to 2^63, which no longer fits a CBLTimestamp, hence the strict comparison
+  if (!(expiration >= 0 && isfinite(expiration) && expiration < (double)INT64_MAX))
+  {
+    napi_throw_range_error(env, NULL, "expiration must be a finite timestamp, not before the epoch");
+    return NULL;
+  }
+
+  convert_arena arena;
+  convertArena_Init(&arena);
+
+  CBLError err;
+  bool didSet = CBLDatabase_SetDocumentExpiration(databaseRef->database, napiValueToFLString(env, args[1], &arena), (CBLTimestamp)expiration, &err);
+  convertArena_Free(&arena);
+
+  if (!didSet)
+  {
+    throwCBLError(env, err);
+    return NULL;
+  }
+
+  napi_value res;
+  CHECK(napi_get_boolean(env, true, &res));
+
+  return res;
+}
+
+// CBLDatabase_GetDocumentExpiration, as a Date, or null if the document doesn't expire
+napi_value Database_GetDocumentExpiration(napi_env env, napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
+
+  convert_arena arena;
+  convertArena_Init(&arena);
+
+  CBLError err;
+  err.code = 0;
+  CBLTimestamp expiration = CBLDatabase_GetDocumentExpiration(databaseRef->database, napiValueToFLString(env, args[1], &arena), &err);
+  convertArena_Free(&arena);
+
+  if (expiration < 0)
+  {
+    throwCBLError(env, err);
+    return NULL;
+  }
+
+  napi_value res;
+
+  if (expiration == 0)
+  {
+    CHECK(napi_get_null(env, &res));
+  }
+  else
+  {
+    CHECK(napi_create_date(env, (double)expiration, &res));
+  }
+
+  return res;
+}
+
+// CBLDatabase_PurgeDocumentByID for many IDs, in a single transaction. IDs that don't exist are skipped; any other
+// failure rolls the whole batch back. Returns the number of documents purged.
+napi_value Database_PurgeDocuments(napi_env env, napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_database_ref *databaseRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&databaseRef));
+  if (!databaseRef->isOpen)
+  {
+    napi_throw_error(env, "", "Database is closed");
+    return NULL;
+  }
+
+  document_batch batch;
+  if (!initDocumentBatch(env, &batch, args[1], NULL))
+  {
+    freeDocumentBatch(&batch);
+    return NULL;
+  }
+
+  CBLError err;
+  uint32_t purged = 0;
+  bool failed = !CBLDatabase_BeginTransaction(databaseRef->database, &err);
+
+  for (uint32_t i = 0; i < batch.count && !failed; i++)
+  {
+    err.code = 0;
+
+    if (CBLDatabase_PurgeDocumentByID(databaseRef->database, batch.ids[i], &err))
+    {
+      purged++;
+      countTransactionOp(databaseRef);
+    }
+    else if (!(err.domain == kCBLDomain && err.code == kCBLErrorNotFound))
+    {
+      failed = true;
+    }
+
+    if (databaseRef->documentCache)
+    {
+      documentCache_Invalidate(databaseRef->documentCache, batch.ids[i]);
+    }
+  }
+
+  if (failed)
+  {
+    // Keep the purge error rather than any from the rollback
+    CBLError rollbackErr;
+    CBLDatabase_EndTransaction(databaseRef->database, false, &rollbackErr);
+  }
+  else
+  {
+    failed = !CBLDatabase_EndTransaction(databaseRef->database, true, &err);
+  }
+
+  freeDocumentBatch(&batch);
+
+  if (failed)
+  {
+    throwCBLError(env, err);
+    return NULL;
+  }
+
+  napi_value res;
+  CHECK(napi_create_uint32(env, purged, &res));
+
+  return res;
+}
+
+// CBLDocument_SetJSON
+napi_value Document_SetJSON(napi_env env, napi_callback_info info)
+{
+
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
+  CBLDocument *doc = docRef->document;
+
+  size_t str_size;
+  napi_get_value_string_utf8(env, args[1], NULL, 0, &str_size);
+  char *json;
+  json = (char *)calloc(str_size + 1, sizeof(char));
+  str_size = str_size + 1;
+  napi_get_value_string_utf8(env, args[1], json, str_size, NULL);
+
+  CBLError err;
+  bool didSetJson = CBLDocument_SetJSON(doc, FLStr(json), &err);
+
+  if (!didSetJson)
+  {
+    napi_throw_error(env, "", "Set JSON failed");
+  }
+
+  napi_value res;
+  CHECK(napi_get_boolean(env, didSetJson, &res));
+
+  return res;
+}
+
+// CBLDocument_SetProperties
+napi_value Document_SetProperties(napi_env env, napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
 
   external_document_ref *docRef;
   CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
@@ -310,6 +1895,12 @@ napi_value Document_SetProperties(napi_env env, napi_callback_info info)
 
   FLMutableDict value = napiValueToFLDict(env, args[1]);
 
+  if (!value)
+  {
+    napi_throw_error(env, "", "Error encoding document properties");
+    return NULL;
+  }
+
   CBLDocument_SetProperties(doc, value);
   FLMutableDict_Release(value);
 
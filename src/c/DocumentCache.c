@@ -0,0 +1,408 @@
+#include <stdlib.h>
+#include <string.h>
+#include "DocumentCache.h"
+#include "NapiConvert.h"
+#include "util.h"
+
+static uint32_t hashDocID(FLString docID)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < docID.size; i++)
+  {
+    hash = (hash ^ ((const uint8_t *)docID.buf)[i]) * 16777619u;
+  }
+
+  return hash;
+}
+
+static document_cache_entry **findSlot(document_cache *cache, FLString docID, uint32_t hash)
+{
+  document_cache_entry **slot = &cache->buckets[hash & (cache->bucketCount - 1)];
+
+  while (*slot && !((*slot)->hash == hash && (*slot)->docIDSize == docID.size && memcmp((*slot)->docID, docID.buf, docID.size) == 0))
+  {
+    slot = &(*slot)->chain;
+  }
+
+  return slot;
+}
+
+static void unlinkEntry(document_cache *cache, document_cache_entry *entry)
+{
+  if (entry->prev)
+  {
+    entry->prev->next = entry->next;
+  }
+  else
+  {
+    cache->head = entry->next;
+  }
+
+  if (entry->next)
+  {
+    entry->next->prev = entry->prev;
+  }
+  else
+  {
+    cache->tail = entry->prev;
+  }
+}
+
+static void linkEntryAtHead(document_cache *cache, document_cache_entry *entry)
+{
+  entry->prev = NULL;
+  entry->next = cache->head;
+
+  if (cache->head)
+  {
+    cache->head->prev = entry;
+  }
+  else
+  {
+    cache->tail = entry;
+  }
+
+  cache->head = entry;
+}
+
+// Must be called with the mutex held
+static void queuePendingRef(document_cache *cache, napi_ref ref)
+{
+  if (cache->pendingRefCount == cache->pendingRefCapacity)
+  {
+    cache->pendingRefCapacity = cache->pendingRefCapacity ? cache->pendingRefCapacity * 2 : 16;
+    cache->pendingRefs = realloc(cache->pendingRefs, cache->pendingRefCapacity * sizeof(*cache->pendingRefs));
+  }
+
+  cache->pendingRefs[cache->pendingRefCount++] = ref;
+}
+
+static void deletePendingRefs(napi_env env, document_cache *cache)
+{
+  uv_mutex_lock(&cache->mutex);
+
+  for (size_t i = 0; i < cache->pendingRefCount; i++)
+  {
+    CHECK(napi_delete_reference(env, cache->pendingRefs[i]));
+  }
+
+  cache->pendingRefCount = 0;
+
+  uv_mutex_unlock(&cache->mutex);
+}
+
+// Must be called with the mutex held
+static void removeEntry(document_cache *cache, document_cache_entry **slot)
+{
+  document_cache_entry *entry = *slot;
+
+  *slot = entry->chain;
+  unlinkEntry(cache, entry);
+  cache->stats.count--;
+
+  CBLDocument_Release(entry->document);
+
+  if (entry->properties)
+  {
+    queuePendingRef(cache, entry->properties);
+  }
+
+  free(entry);
+}
+
+// Must be called with the mutex held
+static void insertEntry(document_cache *cache, FLString docID, uint32_t hash, const CBLDocument *document)
+{
+  document_cache_entry **slot = findSlot(cache, docID, hash);
+
+  if (*slot)
+  {
+    return;
+  }
+
+  if (cache->stats.count == cache->capacity)
+  {
+    document_cache_entry *lru = cache->tail;
+    removeEntry(cache, findSlot(cache, (FLString){lru->docID, lru->docIDSize}, lru->hash));
+    cache->stats.evictions++;
+
+    // Evicting may have changed the bucket this entry goes into
+    slot = findSlot(cache, docID, hash);
+  }
+
+  document_cache_entry *entry = malloc(sizeof(*entry) + docID.size);
+  entry->chain = NULL;
+  entry->hash = hash;
+  entry->document = CBLDocument_Retain(document);
+  entry->properties = NULL;
+  entry->docIDSize = docID.size;
+  memcpy(entry->docID, docID.buf, docID.size);
+
+  *slot = entry;
+  linkEntryAtHead(cache, entry);
+  cache->stats.count++;
+}
+
+static void DocumentCacheChangeListener(void *context, const CBLDatabase *db, unsigned numDocs, FLString docIDs[])
+{
+  for (unsigned i = 0; i < numDocs; i++)
+  {
+    documentCache_Invalidate((document_cache *)context, docIDs[i]);
+  }
+}
+
+document_cache *documentCache_New(CBLDatabase *database, uint32_t capacity, bool cacheProperties)
+{
+  document_cache *cache = calloc(1, sizeof(*cache));
+  uv_mutex_init(&cache->mutex);
+  cache->refCount = 1;
+  cache->isActive = true;
+  cache->cacheProperties = cacheProperties;
+  cache->capacity = capacity;
+  cache->stats.capacity = capacity;
+
+  // Stop at 2^31 buckets so the count can't overflow; larger caches just have longer chains
+  cache->bucketCount = 16;
+  while (cache->bucketCount < capacity && cache->bucketCount < 1u << 31)
+  {
+    cache->bucketCount *= 2;
+  }
+  cache->buckets = calloc(cache->bucketCount, sizeof(*cache->buckets));
+
+  cache->listener = CBLDatabase_AddChangeListener(database, DocumentCacheChangeListener, cache);
+
+  return cache;
+}
+
+document_cache *documentCache_Retain(document_cache *cache)
+{
+  uv_mutex_lock(&cache->mutex);
+  cache->refCount++;
+  uv_mutex_unlock(&cache->mutex);
+
+  return cache;
+}
+
+// Called on the JS thread, by the database ref and by async work once it has completed
+void documentCache_Release(napi_env env, document_cache *cache)
+{
+  uv_mutex_lock(&cache->mutex);
+  bool isLast = --cache->refCount == 0;
+  uv_mutex_unlock(&cache->mutex);
+
+  if (!isLast)
+  {
+    return;
+  }
+
+  documentCache_Stop(env, cache);
+  uv_mutex_destroy(&cache->mutex);
+  free(cache->pendingRefs);
+  free(cache->buckets);
+  free(cache);
+}
+
+// Removes the change listener and drops every entry. Lookups on a stopped cache go straight to the database.
+void documentCache_Stop(napi_env env, document_cache *cache)
+{
+  uv_mutex_lock(&cache->mutex);
+  cache->isActive = false;
+  CBLListenerToken *listener = cache->listener;
+  cache->listener = NULL;
+  uv_mutex_unlock(&cache->mutex);
+
+  // Outside the lock, since a notification in flight may be waiting for it
+  if (listener)
+  {
+    CBLListener_Remove(listener);
+  }
+
+  uv_mutex_lock(&cache->mutex);
+
+  while (cache->head)
+  {
+    removeEntry(cache, findSlot(cache, (FLString){cache->head->docID, cache->head->docIDSize}, cache->head->hash));
+  }
+
+  // Every bucket lookup checks isActive first, so the table can go now rather than when the cache is freed
+  free(cache->buckets);
+  cache->buckets = NULL;
+
+  uv_mutex_unlock(&cache->mutex);
+
+  deletePendingRefs(env, cache);
+}
+
+// Stops a cache whose database stays open, and keeps the caller's reference to it on stoppedCaches: a change
+// notification that was already being delivered when the listener was removed may still invalidate it.
+void documentCache_Retire(napi_env env, document_cache *cache, document_cache **stoppedCaches)
+{
+  documentCache_Stop(env, cache);
+
+  cache->nextStopped = *stoppedCaches;
+  *stoppedCaches = cache;
+}
+
+// Called once the database is closed, when no change notification can still be running
+void documentCache_ReleaseStopped(napi_env env, document_cache **stoppedCaches)
+{
+  while (*stoppedCaches)
+  {
+    document_cache *cache = *stoppedCaches;
+    *stoppedCaches = cache->nextStopped;
+    documentCache_Release(env, cache);
+  }
+}
+
+// Returns a retained document, or NULL with err->code 0 if it doesn't exist
+const CBLDocument *documentCache_GetDocument(document_cache *cache, CBLDatabase *database, FLString docID, CBLError *err)
+{
+  uint32_t hash = hashDocID(docID);
+
+  uv_mutex_lock(&cache->mutex);
+
+  if (cache->isActive)
+  {
+    document_cache_entry **slot = findSlot(cache, docID, hash);
+
+    if (*slot)
+    {
+      document_cache_entry *entry = *slot;
+      unlinkEntry(cache, entry);
+      linkEntryAtHead(cache, entry);
+      cache->stats.hits++;
+
+      const CBLDocument *doc = CBLDocument_Retain(entry->document);
+      uv_mutex_unlock(&cache->mutex);
+
+      return doc;
+    }
+
+    cache->stats.misses++;
+  }
+
+  uint64_t generation = cache->generation;
+  uv_mutex_unlock(&cache->mutex);
+
+  err->code = 0;
+  const CBLDocument *doc = CBLDatabase_GetDocument(database, docID, err);
+
+  if (doc)
+  {
+    uv_mutex_lock(&cache->mutex);
+
+    if (cache->isActive && cache->generation == generation)
+    {
+      insertEntry(cache, docID, hash, doc);
+    }
+
+    uv_mutex_unlock(&cache->mutex);
+  }
+
+  return doc;
+}
+
+// Returns the document's properties, frozen if the cache keeps them, or JS null if it doesn't exist. Returns NULL on
+// error.
+napi_value documentCache_GetProperties(napi_env env, document_cache *cache, CBLDatabase *database, FLString docID, CBLError *err)
+{
+  deletePendingRefs(env, cache);
+
+  napi_value res = NULL;
+  uint32_t hash = hashDocID(docID);
+
+  uv_mutex_lock(&cache->mutex);
+
+  if (cache->isActive)
+  {
+    document_cache_entry *entry = *findSlot(cache, docID, hash);
+
+    if (entry && entry->properties)
+    {
+      CHECK(napi_get_reference_value(env, entry->properties, &res));
+      unlinkEntry(cache, entry);
+      linkEntryAtHead(cache, entry);
+      cache->stats.hits++;
+    }
+  }
+
+  uv_mutex_unlock(&cache->mutex);
+
+  if (res)
+  {
+    return res;
+  }
+
+  const CBLDocument *doc = documentCache_GetDocument(cache, database, docID, err);
+
+  if (!doc)
+  {
+    if (err->code != 0)
+    {
+      return NULL;
+    }
+
+    CHECK(napi_get_null(env, &res));
+    return res;
+  }
+
+  if (!cache->cacheProperties)
+  {
+    res = flDictToNapiValue(env, CBLDocument_Properties(doc));
+    CBLDocument_Release(doc);
+    return res;
+  }
+
+  // Cached properties are shared by every caller, so they are frozen
+  res = flDictToFrozenNapiValue(env, CBLDocument_Properties(doc));
+
+  uv_mutex_lock(&cache->mutex);
+
+  document_cache_entry *entry = cache->isActive ? *findSlot(cache, docID, hash) : NULL;
+
+  if (entry && entry->document == doc && !entry->properties)
+  {
+    CHECK(napi_create_reference(env, res, 1, &entry->properties));
+  }
+
+  uv_mutex_unlock(&cache->mutex);
+
+  CBLDocument_Release(doc);
+
+  return res;
+}
+
+void documentCache_Invalidate(document_cache *cache, FLString docID)
+{
+  uint32_t hash = hashDocID(docID);
+
+  uv_mutex_lock(&cache->mutex);
+
+  cache->generation++;
+
+  if (cache->isActive)
+  {
+    document_cache_entry **slot = findSlot(cache, docID, hash);
+
+    if (*slot)
+    {
+      removeEntry(cache, slot);
+      cache->stats.invalidations++;
+    }
+  }
+
+  uv_mutex_unlock(&cache->mutex);
+}
+
+document_cache_stats documentCache_Stats(napi_env env, document_cache *cache)
+{
+  deletePendingRefs(env, cache);
+
+  uv_mutex_lock(&cache->mutex);
+  document_cache_stats stats = cache->stats;
+  uv_mutex_unlock(&cache->mutex);
+
+  return stats;
+}
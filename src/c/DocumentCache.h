@@ -0,0 +1,66 @@
+#pragma once
+#include <node_api.h>
+#include <uv.h>
+#include "cbl/CouchbaseLite.h"
+
+// Bounded LRU of immutable documents for one database, keyed by document ID, and optionally of their converted
+// properties as frozen JS objects. Entries are dropped by a native database change listener, and straight away by
+// this module's own writes. Documents may be looked up and invalidated from any thread; JS references are only
+// created and deleted on the JS thread, so ones dropped elsewhere are queued until the next JS-thread call.
+//
+// Removing the change listener doesn't wait for a notification that is already being delivered on another thread,
+// so a stopped cache is kept (empty) on its database ref's list of stopped caches until the database is closed.
+typedef struct DocumentCacheEntry
+{
+  struct DocumentCacheEntry *prev; // towards the most recently used entry
+  struct DocumentCacheEntry *next; // towards the least recently used entry
+  struct DocumentCacheEntry *chain;
+  uint32_t hash;
+  const CBLDocument *document;
+  napi_ref properties;
+  size_t docIDSize;
+  char docID[];
+} document_cache_entry;
+
+typedef struct DocumentCacheStats
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t invalidations;
+  uint32_t count;
+  uint32_t capacity;
+} document_cache_stats;
+
+typedef struct DocumentCache
+{
+  uv_mutex_t mutex;
+  uint32_t refCount;
+  bool isActive;
+  bool cacheProperties;
+  uint32_t capacity;
+  uint32_t bucketCount;
+  document_cache_entry **buckets;
+  document_cache_entry *head;
+  document_cache_entry *tail;
+  // Bumped by every invalidation, so a lookup that raced with a write doesn't cache what it read
+  uint64_t generation;
+  document_cache_stats stats;
+  napi_ref *pendingRefs;
+  size_t pendingRefCount;
+  size_t pendingRefCapacity;
+  CBLListenerToken *listener;
+  struct DocumentCache *nextStopped;
+} document_cache;
+
+document_cache *documentCache_New(CBLDatabase *database, uint32_t capacity, bool cacheProperties);
+document_cache *documentCache_Retain(document_cache *cache);
+void documentCache_Release(napi_env env, document_cache *cache);
+void documentCache_Stop(napi_env env, document_cache *cache);
+void documentCache_Retire(napi_env env, document_cache *cache, document_cache **stoppedCaches);
+void documentCache_ReleaseStopped(napi_env env, document_cache **stoppedCaches);
+
+const CBLDocument *documentCache_GetDocument(document_cache *cache, CBLDatabase *database, FLString docID, CBLError *err);
+napi_value documentCache_GetProperties(napi_env env, document_cache *cache, CBLDatabase *database, FLString docID, CBLError *err);
+void documentCache_Invalidate(document_cache *cache, FLString docID);
+document_cache_stats documentCache_Stats(napi_env env, document_cache *cache);
@@ -1,5 +1,235 @@
+#include <math.h>
+#include <string.h>
 #include "NapiConvert.h"
 
+void convertArena_Init(convert_arena *arena)
+{
+  arena->stackUsed = 0;
+  arena->blocks = NULL;
+}
+
+void convertArena_Free(convert_arena *arena)
+{
+  convert_arena_block *block = arena->blocks;
+
+  while (block)
+  {
+    convert_arena_block *next = block->next;
+    free(block);
+    block = next;
+  }
+
+  arena->stackUsed = 0;
+  arena->blocks = NULL;
+}
+
+// Bytes that can be handed out without allocating a new block
+static size_t convertArena_Available(convert_arena *arena)
+{
+  if (arena->blocks)
+  {
+    return arena->blocks->size - arena->blocks->used;
+  }
+
+  return CONVERT_ARENA_STACK_SIZE - arena->stackUsed;
+}
+
+static char *convertArena_Next(convert_arena *arena)
+{
+  if (arena->blocks)
+  {
+    return arena->blocks->data + arena->blocks->used;
+  }
+
+  return arena->stack + arena->stackUsed;
+}
+
+static void convertArena_Commit(convert_arena *arena, size_t size)
+{
+  if (arena->blocks)
+  {
+    arena->blocks->used += size;
+  }
+  else
+  {
+    arena->stackUsed += size;
+  }
+}
+
+static convert_allocation_stats allocationStats;
+
+static void countConvertAllocation(size_t size)
+{
+  allocationStats.count++;
+  allocationStats.bytes += size;
+}
+
+convert_allocation_stats convertAllocationStats(void)
+{
+  return allocationStats;
+}
+
+char *convertArena_Alloc(convert_arena *arena, size_t size)
+{
+  if (convertArena_Available(arena) < size)
+  {
+    size_t blockSize = size > CONVERT_ARENA_BLOCK_SIZE ? size : CONVERT_ARENA_BLOCK_SIZE;
+    convert_arena_block *block = malloc(sizeof(*block) + blockSize);
+    countConvertAllocation(sizeof(*block) + blockSize);
+    block->next = arena->blocks;
+    block->size = blockSize;
+    block->used = 0;
+    arena->blocks = block;
+  }
+
+  char *res = convertArena_Next(arena);
+  convertArena_Commit(arena, size);
+
+  return res;
+}
+
+convert_arena_mark convertArena_Mark(convert_arena *arena)
+{
+  convert_arena_mark mark = {arena->stackUsed, arena->blocks, arena->blocks ? arena->blocks->used : 0};
+
+  return mark;
+}
+
+void convertArena_Rewind(convert_arena *arena, convert_arena_mark mark)
+{
+  while (arena->blocks != mark.blocks)
+  {
+    convert_arena_block *next = arena->blocks->next;
+    free(arena->blocks);
+    arena->blocks = next;
+  }
+
+  arena->stackUsed = mark.stackUsed;
+
+  if (arena->blocks)
+  {
+    arena->blocks->used = mark.blockUsed;
+  }
+}
+
+static void finalizeConvertEnvData(napi_env env, void *data, void *hint)
+{
+  convert_env_data *envData = (convert_env_data *)data;
+
+  for (uint32_t i = 0; i < PROPERTY_KEY_CACHE_SIZE; i++)
+  {
+    free(envData->propertyKeyCache[i].key);
+  }
+
+  CHECK(napi_delete_reference(env, envData->propertyKeys));
+  free(envData);
+}
+
+void initConvertEnvData(napi_env env)
+{
+  convert_env_data *envData = calloc(1, sizeof(*envData));
+
+  napi_value propertyKeys;
+  CHECK(napi_create_array(env, &propertyKeys));
+  CHECK(napi_create_reference(env, propertyKeys, 1, &envData->propertyKeys));
+
+  CHECK(napi_set_instance_data(env, envData, finalizeConvertEnvData, NULL));
+}
+
+static convert_env_data *getConvertEnvData(napi_env env)
+{
+  convert_env_data *envData;
+  CHECK(napi_get_instance_data(env, (void **)&envData));
+
+  return envData;
+}
+
+static napi_value createNapiPropertyKey(napi_env env, FLString key)
+{
+  napi_value res;
+  CHECK(napi_create_string_utf8(env, key.buf, key.size, &res));
+
+  return res;
+}
+
+static bool allowsBigInt(convert_env_data *envData)
+{
+  return !envData || envData->bigIntPolicy != kBigIntPolicyNever;
+}
+
+convert_context beginConvertContext(napi_env env)
+{
+  convert_context context = {getConvertEnvData(env), NULL, true};
+  context.allowBigInt = allowsBigInt(context.envData);
+
+  if (context.envData)
+  {
+    CHECK(napi_get_reference_value(env, context.envData->propertyKeys, &context.propertyKeys));
+  }
+
+  return context;
+}
+
+// FNV-1a
+static uint32_t hashPropertyKey(FLString key)
+{
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < key.size; i++)
+  {
+    hash ^= ((const uint8_t *)key.buf)[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+napi_value flStringToNapiPropertyKey(napi_env env, convert_context *context, FLString key)
+{
+  convert_env_data *envData = context->envData;
+
+  if (!envData || key.size > PROPERTY_KEY_MAX_LENGTH)
+  {
+    return createNapiPropertyKey(env, key);
+  }
+
+  uint32_t hash = hashPropertyKey(key);
+  uint32_t slot = hash & (PROPERTY_KEY_CACHE_SIZE - 1);
+  property_key_cache_entry *entry = &envData->propertyKeyCache[slot];
+
+  // Linear probing; the table never fills past PROPERTY_KEY_CACHE_MAX_COUNT so an empty slot is always reached
+  while (entry->key)
+  {
+    if (entry->hash == hash && entry->size == key.size && memcmp(entry->key, key.buf, key.size) == 0)
+    {
+      napi_value res;
+      CHECK(napi_get_element(env, context->propertyKeys, entry->index, &res));
+
+      return res;
+    }
+
+    slot = (slot + 1) & (PROPERTY_KEY_CACHE_SIZE - 1);
+    entry = &envData->propertyKeyCache[slot];
+  }
+
+  napi_value res = createNapiPropertyKey(env, key);
+
+  if (envData->propertyKeyCount >= PROPERTY_KEY_CACHE_MAX_COUNT)
+  {
+    return res;
+  }
+
+  CHECK(napi_set_element(env, context->propertyKeys, envData->propertyKeyCount, res));
+
+  entry->hash = hash;
+  entry->index = envData->propertyKeyCount++;
+  entry->size = key.size;
+  entry->key = malloc(key.size ? key.size : 1);
+  memcpy(entry->key, key.buf, key.size);
+
+  return res;
+}
+
 bool isArray(napi_env env, napi_value value)
 {
   bool isArray;
@@ -16,18 +246,38 @@ bool napiValueToCBool(napi_env env, napi_value value)
   return res;
 }
 
-double napiValueToCDouble(napi_env env, napi_value value)
+// Reads the boolean option `name`, false if it is left out. Throws a TypeError and returns false for other types.
+bool napiOptionToCBool(napi_env env, napi_value options, const char *name, bool *res)
 {
-  double res;
-  CHECK(napi_get_value_double(env, value, &res));
+  napi_value value;
+  CHECK(napi_get_named_property(env, options, name, &value));
 
-  return res;
+  napi_valuetype type;
+  CHECK(napi_typeof(env, value, &type));
+
+  if (type == napi_undefined)
+  {
+    *res = false;
+    return true;
+  }
+
+  if (type != napi_boolean)
+  {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Wrong arguments: %s must be a boolean", name);
+    napi_throw_type_error(env, NULL, msg);
+    return false;
+  }
+
+  *res = napiValueToCBool(env, value);
+
+  return true;
 }
 
-int32_t napiValueToCInt32(napi_env env, napi_value value)
+double napiValueToCDouble(napi_env env, napi_value value)
 {
-  int32_t res;
-  CHECK(napi_get_value_int32(env, value, &res));
+  double res;
+  CHECK(napi_get_value_double(env, value, &res));
 
   return res;
 }
@@ -43,342 +293,816 @@ int64_t napiValueToCInt64(napi_env env, napi_value value)
   return res;
 }
 
-FLString napiValueToFLString(napi_env env, napi_value value)
+// Reads a JS number that must be an integer in 1..UINT32_MAX; false for anything else, including NaN and fractions
+bool napiValueToPositiveUInt32(napi_env env, napi_value value, uint32_t *res)
 {
-  size_t str_size;
-  CHECK(napi_get_value_string_utf8(env, value, NULL, 0, &str_size));
+  double number = napiValueToCDouble(env, value);
+
+  if (!(number >= 1 && number <= UINT32_MAX) || number != (double)(uint32_t)number)
+  {
+    return false;
+  }
 
-  char *string;
-  str_size = str_size + 1;
-  string = (char *)calloc(str_size, sizeof(char));
-  CHECK(napi_get_value_string_utf8(env, value, string, str_size, NULL));
+  *res = (uint32_t)number;
 
-  return FLStr(string);
+  return true;
 }
 
-FLMutableDict napiValueToFLDict(napi_env env, napi_value object)
+// Reads the option `name` with napiValueToPositiveUInt32, leaving *res as the default if it is left out. Throws a
+// TypeError for non-numbers and a RangeError for numbers it rejects, and returns false.
+bool napiOptionToPositiveUInt32(napi_env env, napi_value options, const char *name, uint32_t *res)
 {
-  FLMutableDict res = FLMutableDict_New();
+  napi_value value;
+  CHECK(napi_get_named_property(env, options, name, &value));
 
-  napi_value propertyNames;
-  CHECK(napi_get_property_names(env, object, &propertyNames));
+  napi_valuetype type;
+  CHECK(napi_typeof(env, value, &type));
 
-  uint32_t propertyCount;
-  CHECK(napi_get_array_length(env, propertyNames, &propertyCount));
+  if (type == napi_undefined)
+  {
+    return true;
+  }
+
+  char msg[128];
 
-  for (uint32_t i = 0; i < propertyCount; i++)
+  if (type != napi_number)
   {
-    napi_value napiKey;
-    CHECK(napi_get_element(env, propertyNames, i, &napiKey));
-    FLString key = napiValueToFLString(env, napiKey);
+    snprintf(msg, sizeof(msg), "Wrong arguments: %s must be a number", name);
+    napi_throw_type_error(env, NULL, msg);
+    return false;
+  }
 
-    napi_value napiValue;
-    CHECK(napi_get_property(env, object, napiKey, &napiValue));
+  if (!napiValueToPositiveUInt32(env, value, res))
+  {
+    snprintf(msg, sizeof(msg), "%s must be a positive integer", name);
+    napi_throw_range_error(env, NULL, msg);
+    return false;
+  }
 
-    napi_valuetype type;
-    CHECK(napi_typeof(env, napiValue, &type));
+  return true;
+}
 
-    // napi_undefined, napi_symbol, napi_function, and napi_external are not supported and will be ignored
-    switch (type)
-    {
-    case napi_null:
-      FLMutableDict_SetNull(res, key);
-      break;
-    case napi_boolean:
-      FLMutableDict_SetBool(res, key, napiValueToCBool(env, napiValue));
-      break;
-    case napi_number:
+void napiBigIntToFLEncoder(napi_env env, FLEncoder enc, napi_value value)
+{
+  bool lossless;
+
+  int64_t asInt64;
+  CHECK(napi_get_value_bigint_int64(env, value, &asInt64, &lossless));
+
+  if (lossless)
+  {
+    FLEncoder_WriteInt(enc, asInt64);
+    return;
+  }
+
+  uint64_t asUInt64;
+  CHECK(napi_get_value_bigint_uint64(env, value, &asUInt64, &lossless));
+
+  if (lossless)
+  {
+    FLEncoder_WriteUInt(enc, asUInt64);
+    return;
+  }
+
+  // Fleece integers are at most 64 bits wide, so store anything larger as the nearest double
+  size_t wordCount;
+  CHECK(napi_get_value_bigint_words(env, value, NULL, &wordCount, NULL));
+
+  uint64_t *words = malloc(wordCount * sizeof(*words));
+  int signBit;
+  CHECK(napi_get_value_bigint_words(env, value, &signBit, &wordCount, words));
+
+  double res = 0;
+
+  for (size_t i = wordCount; i > 0; i--)
+  {
+    res = res * 18446744073709551616.0 + (double)words[i - 1];
+  }
+
+  free(words);
+  FLEncoder_WriteDouble(enc, signBit ? -res : res);
+}
+
+FLString napiValueToFLString(napi_env env, napi_value value, convert_arena *arena)
+{
+  // Optimistically copy into whatever scratch space is left. Node only writes whole UTF-8 sequences, so a truncated
+  // copy fills the buffer to within 4 bytes of its end; anything shorter than that is the complete string.
+  size_t available = convertArena_Available(arena);
+  char *string = convertArena_Next(arena);
+  size_t str_size = 0;
+
+  if (available > 4)
+  {
+    CHECK(napi_get_value_string_utf8(env, value, string, available, &str_size));
+
+    if (str_size + 4 < available)
     {
-      int32_t asInt = napiValueToCInt32(env, napiValue);
-      double asDouble = napiValueToCDouble(env, napiValue);
+      convertArena_Commit(arena, str_size + 1);
+      return (FLString){string, str_size};
+    }
+  }
 
-      if (asDouble == asInt)
-      {
-        FLMutableDict_SetInt(res, key, asInt);
-      }
-      else
-      {
-        FLMutableDict_SetDouble(res, key, asDouble);
-      }
+  CHECK(napi_get_value_string_utf8(env, value, NULL, 0, &str_size));
+  string = convertArena_Alloc(arena, str_size + 1);
+  CHECK(napi_get_value_string_utf8(env, value, string, str_size + 1, NULL));
+
+  return (FLString){string, str_size};
+}
+
+void napiValueToFLEncoder(napi_env env, FLEncoder enc, napi_value value, convert_arena *arena)
+{
+  napi_valuetype type;
+  CHECK(napi_typeof(env, value, &type));
+
+  switch (type)
+  {
+  case napi_null:
+    FLEncoder_WriteNull(enc);
+    break;
+  case napi_boolean:
+    FLEncoder_WriteBool(enc, napiValueToCBool(env, value));
+    break;
+  case napi_number:
+  {
+    double number = napiValueToCDouble(env, value);
+
+    // Every safe integer round-trips through int64; -0 and anything fractional or larger stays a double
+    if (number >= -MAX_SAFE_INTEGER && number <= MAX_SAFE_INTEGER && number == (double)(int64_t)number && !(number == 0 && signbit(number)))
+    {
+      FLEncoder_WriteInt(enc, (int64_t)number);
+    }
+    else
+    {
+      FLEncoder_WriteDouble(enc, number);
+    }
+  }
+  break;
+  case napi_string:
+  {
+    // The encoder copies the string, so its scratch space can be reused straight away
+    convert_arena_mark mark = convertArena_Mark(arena);
+    FLEncoder_WriteString(enc, napiValueToFLString(env, value, arena));
+    convertArena_Rewind(arena, mark);
+  }
+  break;
+  case napi_object:
+    if (isArray(env, value))
+    {
+      napiArrayToFLEncoder(env, enc, value, arena);
+    }
+    else if (!napiBinaryToFLEncoder(env, enc, value))
+    {
+      napiObjectToFLEncoder(env, enc, value, arena);
     }
     break;
-    case napi_string:
-      FLMutableDict_SetString(res, key, napiValueToFLString(env, napiValue));
-      break;
-    case napi_object:
-      if (isArray(env, napiValue))
-      {
-        FLMutableArray arrayValue = napiValueToFLArray(env, napiValue);
-        FLMutableDict_SetArray(res, key, arrayValue);
-        FLMutableArray_Release(arrayValue);
-      }
-      else
+  case napi_bigint:
+    napiBigIntToFLEncoder(env, enc, value);
+    break;
+  case napi_undefined:
+  case napi_symbol:
+  case napi_function:
+  case napi_external:
+    // Callers skip these types, but write null rather than corrupting the encoder if one slips through
+    FLEncoder_WriteNull(enc);
+    break;
+  }
+}
+
+static size_t typedArrayElementSize(napi_typedarray_type type)
+{
+  switch (type)
+  {
+  case napi_int8_array:
+  case napi_uint8_array:
+  case napi_uint8_clamped_array:
+    return 1;
+  case napi_int16_array:
+  case napi_uint16_array:
+    return 2;
+  case napi_int32_array:
+  case napi_uint32_array:
+  case napi_float32_array:
+    return 4;
+  default:
+    return 8;
+  }
+}
+
+bool napiBinaryToFLEncoder(napi_env env, FLEncoder enc, napi_value value)
+{
+  bool isBinary;
+  void *data;
+  size_t size;
+
+  // Buffers are Uint8Arrays, so this also covers them
+  CHECK(napi_is_typedarray(env, value, &isBinary));
+
+  if (isBinary)
+  {
+    napi_typedarray_type type;
+    size_t length;
+    CHECK(napi_get_typedarray_info(env, value, &type, &length, &data, NULL, NULL));
+    size = length * typedArrayElementSize(type);
+  }
+  else
+  {
+    CHECK(napi_is_dataview(env, value, &isBinary));
+
+    if (isBinary)
+    {
+      CHECK(napi_get_dataview_info(env, value, &size, &data, NULL, NULL));
+    }
+    else
+    {
+      CHECK(napi_is_arraybuffer(env, value, &isBinary));
+
+      if (!isBinary)
       {
-        FLMutableDict dictValue = napiValueToFLDict(env, napiValue);
-        FLMutableDict_SetDict(res, key, dictValue);
-        FLMutableDict_Release(dictValue);
+        return false;
       }
-      break;
-    case napi_bigint:
-      FLMutableDict_SetInt(res, key, napiValueToCInt64(env, napiValue));
-      break;
-    case napi_undefined:
-    case napi_symbol:
-    case napi_function:
-    case napi_external:
-      // napi_undefined, napi_symbol, napi_function, and napi_external are not supported and will be ignored
-      break;
+
+      CHECK(napi_get_arraybuffer_info(env, value, &data, &size));
     }
   }
 
+  FLEncoder_WriteData(enc, (FLSlice){data, size});
+
+  return true;
+}
+
+static bool isEncodableType(napi_valuetype type)
+{
+  // napi_undefined, napi_symbol, napi_function, and napi_external are not supported and will be ignored
+  return type != napi_undefined && type != napi_symbol && type != napi_function && type != napi_external;
+}
+
+// Doubles an explicit converter stack, moving it to the heap the first time it outgrows its buffer on the C stack
+static void *growConvertStack(void *stack, void *stackBuffer, size_t *capacity, size_t itemSize)
+{
+  void *res;
+
+  if (stack == stackBuffer)
+  {
+    res = malloc(*capacity * 2 * itemSize);
+    memcpy(res, stack, *capacity * itemSize);
+  }
+  else
+  {
+    res = realloc(stack, *capacity * 2 * itemSize);
+  }
+
+  countConvertAllocation(*capacity * 2 * itemSize);
+  *capacity *= 2;
+
   return res;
 }
 
-FLMutableArray napiValueToFLArray(napi_env env, napi_value array)
+// A dict or array being encoded. Its scope holds the container and its property names, and is closed once the
+// container has been written.
+typedef struct EncodeFrame
+{
+  napi_handle_scope scope;
+  napi_value container;
+  napi_value propertyNames; // NULL for arrays
+  uint32_t index;
+  uint32_t count;
+} encode_frame;
+
+static void beginEncodeFrame(napi_env env, FLEncoder enc, encode_frame *frame, napi_handle_scope scope, napi_value container, bool containerIsArray)
 {
-  FLMutableArray res = FLMutableArray_New();
-  uint32_t arrayLength;
-  CHECK(napi_get_array_length(env, array, &arrayLength));
+  frame->scope = scope;
+  frame->container = container;
+  frame->index = 0;
 
-  for (uint32_t i = 0; i < arrayLength; i++)
+  if (containerIsArray)
   {
-    napi_value napiValue;
-    CHECK(napi_get_element(env, array, i, &napiValue));
+    frame->propertyNames = NULL;
+    CHECK(napi_get_array_length(env, container, &frame->count));
+    FLEncoder_BeginArray(enc, frame->count);
+  }
+  else
+  {
+    CHECK(napi_get_property_names(env, container, &frame->propertyNames));
+    CHECK(napi_get_array_length(env, frame->propertyNames, &frame->count));
+    FLEncoder_BeginDict(enc, frame->count);
+  }
+}
 
-    napi_valuetype type;
-    CHECK(napi_typeof(env, napiValue, &type));
+// Encodes a dict or array with an explicit stack, so nesting depth is bounded by memory rather than the C stack
+static void napiContainerToFLEncoder(napi_env env, FLEncoder enc, napi_value container, bool containerIsArray, convert_arena *arena)
+{
+  encode_frame stackFrames[CONVERT_STACK_SIZE];
+  encode_frame *frames = stackFrames;
+  size_t capacity = CONVERT_STACK_SIZE;
+  size_t depth = 0;
 
-    switch (type)
-    {
-    case napi_null:
-      FLMutableArray_AppendNull(res);
-      break;
-    case napi_boolean:
-      FLMutableArray_AppendBool(res, napiValueToCBool(env, napiValue));
-      break;
-    case napi_number:
-    {
-      int32_t asInt = napiValueToCInt32(env, napiValue);
-      double asDouble = napiValueToCDouble(env, napiValue);
+  napi_handle_scope scope;
+  CHECK(napi_open_handle_scope(env, &scope));
+  beginEncodeFrame(env, enc, &frames[depth++], scope, container, containerIsArray);
+
+  while (depth > 0)
+  {
+    encode_frame *frame = &frames[depth - 1];
 
-      if (asDouble == asInt)
+    if (frame->index == frame->count)
+    {
+      if (frame->propertyNames)
       {
-        FLMutableArray_AppendInt(res, asInt);
+        FLEncoder_EndDict(enc);
       }
       else
       {
-        FLMutableArray_AppendDouble(res, asDouble);
+        FLEncoder_EndArray(enc);
       }
+
+      CHECK(napi_close_handle_scope(env, frame->scope));
+      depth--;
+      continue;
     }
-    break;
-    case napi_string:
-      FLMutableArray_AppendString(res, napiValueToFLString(env, napiValue));
-      break;
-    case napi_object:
-      if (isArray(env, napiValue))
+
+    // Each entry gets its own scope, so only the entries on the path from the root are alive at any time. An entry
+    // that is itself a container hands its scope over to the container's frame.
+    CHECK(napi_open_handle_scope(env, &scope));
+
+    napi_value napiKey = NULL;
+    napi_value napiValue;
+
+    if (frame->propertyNames)
+    {
+      CHECK(napi_get_element(env, frame->propertyNames, frame->index++, &napiKey));
+      CHECK(napi_get_property(env, frame->container, napiKey, &napiValue));
+    }
+    else
+    {
+      CHECK(napi_get_element(env, frame->container, frame->index++, &napiValue));
+    }
+
+    napi_valuetype type;
+    CHECK(napi_typeof(env, napiValue, &type));
+
+    if (isEncodableType(type))
+    {
+      if (napiKey)
       {
-        FLMutableArray arrayValue = napiValueToFLArray(env, napiValue);
-        FLMutableArray_AppendArray(res, arrayValue);
-        FLMutableArray_Release(arrayValue);
+        convert_arena_mark mark = convertArena_Mark(arena);
+        FLEncoder_WriteKey(enc, napiValueToFLString(env, napiKey, arena));
+        convertArena_Rewind(arena, mark);
+      }
+
+      if (type == napi_object)
+      {
+        bool valueIsArray = isArray(env, napiValue);
+
+        if (valueIsArray || !napiBinaryToFLEncoder(env, enc, napiValue))
+        {
+          if (depth == capacity)
+          {
+            frames = growConvertStack(frames, stackFrames, &capacity, sizeof(*frames));
+          }
+
+          beginEncodeFrame(env, enc, &frames[depth++], scope, napiValue, valueIsArray);
+          continue;
+        }
       }
       else
       {
-        FLMutableDict dictValue = napiValueToFLDict(env, napiValue);
-        FLMutableArray_AppendDict(res, dictValue);
-        FLMutableDict_Release(dictValue);
+        napiValueToFLEncoder(env, enc, napiValue, arena);
       }
-      break;
-    case napi_bigint:
-      FLMutableArray_AppendInt(res, napiValueToCInt64(env, napiValue));
-      break;
-    case napi_undefined:
-    case napi_symbol:
-    case napi_function:
-    case napi_external:
-      // napi_undefined, napi_symbol, napi_function, and napi_external are not supported and will be ignored
-      break;
     }
+
+    CHECK(napi_close_handle_scope(env, scope));
   }
 
-  return res;
+  if (frames != stackFrames)
+  {
+    free(frames);
+  }
 }
 
-napi_value flDictToNapiValue(napi_env env, FLDict dict)
+void napiObjectToFLEncoder(napi_env env, FLEncoder enc, napi_value object, convert_arena *arena)
 {
-  napi_value res;
-  CHECK(napi_create_object(env, &res));
+  napiContainerToFLEncoder(env, enc, object, false, arena);
+}
+
+void napiArrayToFLEncoder(napi_env env, FLEncoder enc, napi_value array, convert_arena *arena)
+{
+  napiContainerToFLEncoder(env, enc, array, true, arena);
+}
+
+FLDoc napiObjectToFLDoc(napi_env env, napi_value object)
+{
+  convert_arena arena;
+  convertArena_Init(&arena);
+
+  FLEncoder enc = FLEncoder_New();
+  napiObjectToFLEncoder(env, enc, object, &arena);
 
-  FLDictIterator iter;
-  FLDictIterator_Begin(dict, &iter);
-  FLValue value;
+  FLError err;
+  FLDoc doc = FLEncoder_FinishDoc(enc, &err);
+  FLEncoder_Free(enc);
+  convertArena_Free(&arena);
 
-  while (NULL != (value = FLDictIterator_GetValue(&iter)))
+  return doc;
+}
+
+static FLMutableDict flDocToMutableDict(FLDoc doc)
+{
+  if (!doc)
   {
-    FLString key = FLDictIterator_GetKeyString(&iter);
-    FLValue value = FLDictIterator_GetValue(&iter);
-    FLValueType type = FLValue_GetType(value);
+    return NULL;
+  }
 
-    napi_value napiKey;
-    napi_value napiValue;
+  // A shallow mutable copy of an encoded dict is a single small allocation that retains the doc it points into
+  FLMutableDict res = FLDict_MutableCopy(FLValue_AsDict(FLDoc_GetRoot(doc)), kFLDefaultCopy);
+  FLDoc_Release(doc);
+
+  return res;
+}
+
+FLMutableDict napiValueToFLDict(napi_env env, napi_value object)
+{
+  return flDocToMutableDict(napiObjectToFLDoc(env, object));
+}
+
+FLMutableDict napiValueToFLDictWithEncoder(napi_env env, FLEncoder enc, napi_value object, convert_arena *arena)
+{
+  napiObjectToFLEncoder(env, enc, object, arena);
 
-    CHECK(napi_create_string_utf8(env, key.buf, key.size, &napiKey));
+  // Finishing resets the encoder, so it is ready for the next object
+  FLError err;
+  return flDocToMutableDict(FLEncoder_FinishDoc(enc, &err));
+}
+
+FLSliceResult napiValueToJSON(napi_env env, napi_value value)
+{
+  convert_arena arena;
+  convertArena_Init(&arena);
+
+  FLEncoder enc = FLEncoder_NewWithOptions(kFLEncodeJSON, 0, true);
+  napiValueToFLEncoder(env, enc, value, &arena);
+
+  FLError err;
+  FLSliceResult json = FLEncoder_Finish(enc, &err);
+  FLEncoder_Free(enc);
+  convertArena_Free(&arena);
+
+  return json;
+}
+
+static void finalizeRetainedValue(napi_env env, void *data, void *hint)
+{
+  FLValue_Release((FLValue)hint);
+}
+
+// Data smaller than this is copied. An external buffer needs a retain, a finalizer that V8 has to track until the
+// Buffer is collected, and a release on the finalizer's run, which costs more than copying a few dozen bytes.
+#define EXTERNAL_DATA_MIN_SIZE 64
+
+napi_value flDataToNapiBuffer(napi_env env, FLValue value)
+{
+  FLSlice data = FLValue_AsData(value);
+
+  napi_value res;
 
-    switch (type)
+  if (data.size >= EXTERNAL_DATA_MIN_SIZE)
+  {
+    // Share the Fleece memory with the Buffer; retaining the value keeps the document that owns it alive
+    FLValue_Retain(value);
+    napi_status status = napi_create_external_buffer(env, data.size, (void *)data.buf, finalizeRetainedValue, (void *)value, &res);
+
+    if (status == napi_ok)
     {
-    case kFLUndefined:
-      CHECK(napi_get_undefined(env, &napiValue));
-      break;
-    case kFLNull:
-      CHECK(napi_get_null(env, &napiValue));
-      break;
-    case kFLBoolean:
-      CHECK(napi_get_boolean(env, FLValue_AsBool(value), &napiValue));
-      break;
-    case kFLNumber:
-      if (FLValue_IsInteger(value))
-      {
-        if (FLValue_IsUnsigned(value))
-        {
-          int64_t as64 = FLValue_AsUnsigned(value);
-          int32_t as32 = (int32_t)as64;
+      return res;
+    }
 
-          if (as32 < as64)
-          {
-            CHECK(napi_create_bigint_uint64(env, as64, &napiValue));
-          }
-          else
-          {
-            CHECK(napi_create_uint32(env, as32, &napiValue));
-          }
-        }
-        else
-        {
-          int64_t as64 = FLValue_AsInt(value);
-          int32_t as32 = (int32_t)as64;
+    // Runtimes with a V8 memory cage (e.g. Electron) refuse external memory, so fall back to a copy
+    FLValue_Release(value);
+  }
 
-          if (as32 < as64)
-          {
-            CHECK(napi_create_bigint_int64(env, as64, &napiValue));
-          }
-          else
-          {
-            CHECK(napi_create_int32(env, as32, &napiValue));
-          }
-        }
-      }
-      else
-      {
-        CHECK(napi_create_double(env, FLValue_AsDouble(value), &napiValue));
-      }
-      break;
-    case kFLString:
-      CHECK(napi_create_string_utf8(env, FLValue_AsString(value).buf, FLValue_AsString(value).size, &napiValue));
-      break;
-    case kFLData:
-      // Unsupported: treat data as null
-      CHECK(napi_get_null(env, &napiValue));
-      break;
-    case kFLArray:
-      napiValue = flArrayToNapiValue(env, FLValue_AsArray(value));
-      break;
-    case kFLDict:
-      napiValue = flDictToNapiValue(env, FLValue_AsDict(value));
-      break;
+  CHECK(napi_create_buffer_copy(env, data.size, data.buf, NULL, &res));
+
+  return res;
+}
+
+napi_value flIntegerToNapiValue(napi_env env, FLValue value, bool allowBigInt)
+{
+  napi_value res;
+
+  if (FLValue_IsUnsigned(value))
+  {
+    uint64_t asUInt64 = FLValue_AsUnsigned(value);
+
+    if (asUInt64 > MAX_SAFE_INTEGER && allowBigInt)
+    {
+      CHECK(napi_create_bigint_uint64(env, asUInt64, &res));
     }
+    else
+    {
+      CHECK(napi_create_double(env, (double)asUInt64, &res));
+    }
+  }
+  else
+  {
+    int64_t asInt64 = FLValue_AsInt(value);
+
+    if ((asInt64 > MAX_SAFE_INTEGER || asInt64 < -MAX_SAFE_INTEGER) && allowBigInt)
+    {
+      CHECK(napi_create_bigint_int64(env, asInt64, &res));
+    }
+    else
+    {
+      CHECK(napi_create_int64(env, asInt64, &res));
+    }
+  }
+
+  return res;
+}
+
+void setBigIntPolicy(napi_env env, bigint_policy policy)
+{
+  convert_env_data *envData = getConvertEnvData(env);
 
-    CHECK(napi_set_property(env, res, napiKey, napiValue));
+  if (envData)
+  {
+    envData->bigIntPolicy = policy;
+  }
+}
+
+// Any value but a dict or array
+static napi_value flScalarToNapiValue(napi_env env, FLValue value, bool allowBigInt)
+{
+  napi_value res;
 
-    FLDictIterator_Next(&iter);
+  switch (FLValue_GetType(value))
+  {
+  case kFLUndefined:
+    CHECK(napi_get_undefined(env, &res));
+    break;
+  case kFLNull:
+    CHECK(napi_get_null(env, &res));
+    break;
+  case kFLBoolean:
+    CHECK(napi_get_boolean(env, FLValue_AsBool(value), &res));
+    break;
+  case kFLNumber:
+    if (FLValue_IsInteger(value))
+    {
+      res = flIntegerToNapiValue(env, value, allowBigInt);
+    }
+    else
+    {
+      CHECK(napi_create_double(env, FLValue_AsDouble(value), &res));
+    }
+    break;
+  case kFLString:
+  {
+    FLString string = FLValue_AsString(value);
+    CHECK(napi_create_string_utf8(env, string.buf, string.size, &res));
+  }
+  break;
+  case kFLData:
+    res = flDataToNapiBuffer(env, value);
+    break;
+  default:
+    CHECK(napi_get_undefined(env, &res));
+    break;
   }
 
   return res;
 }
 
-napi_value flArrayToNapiValue(napi_env env, FLArray array)
+napi_value flValueToNapiValue(napi_env env, FLValue value)
 {
-  uint32_t length = FLArray_Count(array);
+  switch (FLValue_GetType(value))
+  {
+  case kFLArray:
+    return flArrayToNapiValue(env, FLValue_AsArray(value));
+  case kFLDict:
+    return flDictToNapiValue(env, FLValue_AsDict(value));
+  default:
+    return flScalarToNapiValue(env, value, allowsBigInt(getConvertEnvData(env)));
+  }
+}
 
+static void finalizeSliceResult(napi_env env, void *data, void *hint)
+{
+  FLSliceResult slice = {data, (size_t)(uintptr_t)hint};
+  FLSliceResult_Release(slice);
+}
+
+napi_value flSliceResultToNapiArrayBuffer(napi_env env, FLSliceResult slice)
+{
   napi_value res;
-  CHECK(napi_create_array_with_length(env, length, &res));
+  napi_status status = napi_create_external_arraybuffer(env, (void *)slice.buf, slice.size, finalizeSliceResult, (void *)(uintptr_t)slice.size, &res);
 
-  FLArrayIterator iter;
-  FLArrayIterator_Begin(array, &iter);
-  FLValue value;
+  if (status == napi_no_external_buffers_allowed)
+  {
+    // Runtimes with a V8 memory cage (e.g. Electron) refuse external memory, so copy into a V8-owned buffer instead
+    void *data;
+    CHECK(napi_create_arraybuffer(env, slice.size, &data, &res));
+    memcpy(data, slice.buf, slice.size);
+    FLSliceResult_Release(slice);
+  }
+  else
+  {
+    CHECK(status);
+  }
 
-  while (NULL != (value = FLArrayIterator_GetValue(&iter)))
+  return res;
+}
+
+// A dict or array being converted. The result lives in an escapable scope and escapes into its parent's entry scope
+// when the container is done; converted entries live in the entry scope, which is recycled every
+// CONVERT_SCOPE_ENTRIES entries. Dict properties are collected into a shared descriptor stack, starting at
+// descriptorBase, and defined in as few napi_define_properties calls as possible.
+typedef struct DecodeFrame
+{
+  napi_escapable_handle_scope scope;
+  napi_handle_scope entryScope;
+  napi_value result;
+  bool isDict;
+  union
   {
-    FLValue value = FLArrayIterator_GetValue(&iter);
-    FLValueType type = FLValue_GetType(value);
+    FLDictIterator dict;
+    FLArrayIterator array;
+  } iter;
+  uint32_t index;
+  size_t descriptorBase;
+  size_t descriptorCount;
+} decode_frame;
 
-    napi_value napiValue;
+static void beginDecodeFrame(napi_env env, decode_frame *frame, FLValue container, bool isDict, size_t descriptorBase)
+{
+  CHECK(napi_open_escapable_handle_scope(env, &frame->scope));
+
+  frame->isDict = isDict;
+  frame->index = 0;
+  frame->descriptorBase = descriptorBase;
+  frame->descriptorCount = 0;
+
+  if (isDict)
+  {
+    CHECK(napi_create_object(env, &frame->result));
+    FLDictIterator_Begin(FLValue_AsDict(container), &frame->iter.dict);
+  }
+  else
+  {
+    // Node-API has no bulk array constructor; preallocating the length keeps V8 from growing the backing store
+    FLArray array = FLValue_AsArray(container);
+    CHECK(napi_create_array_with_length(env, FLArray_Count(array), &frame->result));
+    FLArrayIterator_Begin(array, &frame->iter.array);
+  }
+
+  CHECK(napi_open_handle_scope(env, &frame->entryScope));
+}
+
+static void flushDecodeFrame(napi_env env, decode_frame *frame, napi_property_descriptor *descriptors)
+{
+  if (frame->descriptorCount > 0)
+  {
+    CHECK(napi_define_properties(env, frame->result, frame->descriptorCount, descriptors + frame->descriptorBase));
+    frame->descriptorCount = 0;
+  }
+
+  CHECK(napi_close_handle_scope(env, frame->entryScope));
+}
+
+static void addDecodeEntry(napi_env env, decode_frame *frame, napi_property_descriptor *descriptors, napi_value value)
+{
+  size_t entryCount;
+
+  if (frame->isDict)
+  {
+    descriptors[frame->descriptorBase + frame->descriptorCount - 1].value = value;
+    entryCount = frame->descriptorCount;
+  }
+  else
+  {
+    CHECK(napi_set_element(env, frame->result, frame->index++, value));
+    entryCount = frame->index;
+  }
+
+  if (entryCount % CONVERT_SCOPE_ENTRIES == 0)
+  {
+    flushDecodeFrame(env, frame, descriptors);
+    CHECK(napi_open_handle_scope(env, &frame->entryScope));
+  }
+}
+
+// Converts a dict or array with an explicit stack, so nesting depth is bounded by memory rather than the C stack.
+// Frozen results have every dict and array frozen as it is completed.
+static napi_value flContainerToNapiValue(napi_env env, FLValue container, bool isDict, bool freeze)
+{
+  decode_frame stackFrames[CONVERT_STACK_SIZE];
+  decode_frame *frames = stackFrames;
+  size_t capacity = CONVERT_STACK_SIZE;
+  size_t depth = 0;
+
+  napi_property_descriptor stackDescriptors[DICT_DESCRIPTOR_STACK_SIZE];
+  napi_property_descriptor *descriptors = stackDescriptors;
+  size_t descriptorCapacity = DICT_DESCRIPTOR_STACK_SIZE;
+
+  napi_value res = NULL;
+
+  // Opened in the caller's scope, so the cached key array stays valid for the whole conversion
+  convert_context context = beginConvertContext(env);
+
+  beginDecodeFrame(env, &frames[depth++], container, isDict, 0);
 
-    switch (type)
+  while (depth > 0)
+  {
+    decode_frame *frame = &frames[depth - 1];
+    FLValue value = frame->isDict ? FLDictIterator_GetValue(&frame->iter.dict) : FLArrayIterator_GetValue(&frame->iter.array);
+
+    if (!value)
     {
-    case kFLUndefined:
-      CHECK(napi_get_undefined(env, &napiValue));
-      break;
-    case kFLNull:
-      CHECK(napi_get_null(env, &napiValue));
-      break;
-    case kFLBoolean:
-      CHECK(napi_get_boolean(env, FLValue_AsBool(value), &napiValue));
-      break;
-    case kFLNumber:
-      if (FLValue_IsInteger(value))
+      flushDecodeFrame(env, frame, descriptors);
+
+      if (freeze)
       {
-        if (FLValue_IsUnsigned(value))
-        {
-          int64_t as64 = FLValue_AsUnsigned(value);
-          int32_t as32 = as64;
+        CHECK(napi_object_freeze(env, frame->result));
+      }
 
-          if (as32 < as64)
-          {
-            CHECK(napi_create_bigint_uint64(env, as64, &napiValue));
-          }
-          else
-          {
-            CHECK(napi_create_uint32(env, as32, &napiValue));
-          }
-        }
-        else
-        {
-          int64_t as64 = FLValue_AsInt(value);
-          int32_t as32 = as64;
+      CHECK(napi_escape_handle(env, frame->scope, frame->result, &res));
+      CHECK(napi_close_escapable_handle_scope(env, frame->scope));
 
-          if (as32 < as64)
-          {
-            CHECK(napi_create_bigint_int64(env, as64, &napiValue));
-          }
-          else
-          {
-            CHECK(napi_create_int32(env, as32, &napiValue));
-          }
-        }
+      if (--depth > 0)
+      {
+        addDecodeEntry(env, &frames[depth - 1], descriptors, res);
       }
-      else
+
+      continue;
+    }
+
+    if (frame->isDict)
+    {
+      size_t index = frame->descriptorBase + frame->descriptorCount++;
+
+      if (index == descriptorCapacity)
       {
-        CHECK(napi_create_double(env, FLValue_AsDouble(value), &napiValue));
+        descriptors = growConvertStack(descriptors, stackDescriptors, &descriptorCapacity, sizeof(*descriptors));
       }
-      break;
-    case kFLString:
-      CHECK(napi_create_string_utf8(env, FLValue_AsString(value).buf, FLValue_AsString(value).size, &napiValue));
-      break;
-    case kFLData:
-      // Unsupported: treat data as null
-      CHECK(napi_get_null(env, &napiValue));
-      break;
-    case kFLArray:
-      napiValue = flArrayToNapiValue(env, FLValue_AsArray(value));
-      break;
-    case kFLDict:
-      napiValue = flDictToNapiValue(env, FLValue_AsDict(value));
-      break;
+
+      // The value is filled in by addDecodeEntry, once it has been converted
+      napi_property_descriptor *descriptor = &descriptors[index];
+      descriptor->utf8name = NULL;
+      descriptor->name = flStringToNapiPropertyKey(env, &context, FLDictIterator_GetKeyString(&frame->iter.dict));
+      descriptor->method = NULL;
+      descriptor->getter = NULL;
+      descriptor->setter = NULL;
+      descriptor->value = NULL;
+      descriptor->attributes = napi_default_jsproperty;
+      descriptor->data = NULL;
+
+      FLDictIterator_Next(&frame->iter.dict);
+    }
+    else
+    {
+      FLArrayIterator_Next(&frame->iter.array);
     }
 
-    CHECK(napi_set_element(env, res, length - FLArrayIterator_GetCount(&iter), napiValue));
+    FLValueType type = FLValue_GetType(value);
+
+    if (type == kFLDict || type == kFLArray)
+    {
+      size_t descriptorBase = frame->descriptorBase + frame->descriptorCount;
+
+      if (depth == capacity)
+      {
+        frames = growConvertStack(frames, stackFrames, &capacity, sizeof(*frames));
+      }
+
+      beginDecodeFrame(env, &frames[depth++], value, type == kFLDict, descriptorBase);
+      continue;
+    }
+
+    addDecodeEntry(env, frame, descriptors, flScalarToNapiValue(env, value, context.allowBigInt));
+  }
+
+  if (frames != stackFrames)
+  {
+    free(frames);
+  }
 
-    FLArrayIterator_Next(&iter);
+  if (descriptors != stackDescriptors)
+  {
+    free(descriptors);
   }
 
   return res;
-}
\ No newline at end of file
+}
+
+napi_value flDictToNapiValue(napi_env env, FLDict dict)
+{
+  return flContainerToNapiValue(env, (FLValue)dict, true, false);
+}
+
+napi_value flDictToFrozenNapiValue(napi_env env, FLDict dict)
+{
+  return flContainerToNapiValue(env, (FLValue)dict, true, true);
+}
+
+napi_value flArrayToNapiValue(napi_env env, FLArray array)
+{
+  return flContainerToNapiValue(env, (FLValue)array, false, false);
+}
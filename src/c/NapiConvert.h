@@ -5,17 +5,132 @@
 #include "cbl/CouchbaseLite.h"
 #include "util.h"
 
+// Scratch memory for strings read out of napi values. Short strings are bump-allocated from a buffer that lives on
+// the caller's stack; longer ones spill into heap blocks. Everything is released at once by convertArena_Free.
+#define CONVERT_ARENA_STACK_SIZE 1024
+#define CONVERT_ARENA_BLOCK_SIZE 16384
+
+typedef struct ConvertArenaBlock
+{
+  struct ConvertArenaBlock *next;
+  size_t size;
+  size_t used;
+  char data[];
+} convert_arena_block;
+
+typedef struct ConvertArena
+{
+  char stack[CONVERT_ARENA_STACK_SIZE];
+  size_t stackUsed;
+  convert_arena_block *blocks;
+} convert_arena;
+
+typedef struct ConvertArenaMark
+{
+  size_t stackUsed;
+  convert_arena_block *blocks;
+  size_t blockUsed;
+} convert_arena_mark;
+
+// Heap allocations made by conversions (arena blocks and spilled converter stacks), for the benchmarks. Conversions
+// run on the JS thread, so the counters are only exact while a single environment is converting.
+typedef struct ConvertAllocationStats
+{
+  uint64_t count;
+  uint64_t bytes;
+} convert_allocation_stats;
+
+convert_allocation_stats convertAllocationStats(void);
+
+void convertArena_Init(convert_arena *arena);
+void convertArena_Free(convert_arena *arena);
+char *convertArena_Alloc(convert_arena *arena, size_t size);
+convert_arena_mark convertArena_Mark(convert_arena *arena);
+void convertArena_Rewind(convert_arena *arena, convert_arena_mark mark);
+
+// Nested dicts and arrays are converted with an explicit stack rather than recursion. Frames for the first
+// CONVERT_STACK_SIZE levels, and the first DICT_DESCRIPTOR_STACK_SIZE pending dict properties, live on the C stack;
+// deeper documents move them to the heap. Handle scopes are recycled every CONVERT_SCOPE_ENTRIES entries of a
+// container, which also bounds how many properties a single napi_define_properties call defines.
+#define CONVERT_STACK_SIZE 32
+#define DICT_DESCRIPTOR_STACK_SIZE 32
+#define CONVERT_SCOPE_ENTRIES 1024
+
+// Per-environment cache of property name strings. Node-API 8 cannot reference strings directly, so cached keys are
+// stored in a JS array held by a single reference and looked up by their index in it.
+#define PROPERTY_KEY_CACHE_SIZE 1024
+#define PROPERTY_KEY_CACHE_MAX_COUNT (PROPERTY_KEY_CACHE_SIZE * 3 / 4)
+#define PROPERTY_KEY_MAX_LENGTH 64
+
+typedef struct PropertyKeyCacheEntry
+{
+  uint32_t hash;
+  uint32_t index;
+  size_t size;
+  char *key;
+} property_key_cache_entry;
+
+// Largest integer a JS number holds exactly (Number.MAX_SAFE_INTEGER)
+#define MAX_SAFE_INTEGER 9007199254740991LL
+
+// How Fleece integers outside the safe range are returned to JS
+typedef enum
+{
+  kBigIntPolicyUnsafe, // as BigInts (default)
+  kBigIntPolicyNever,  // as the nearest number
+} bigint_policy;
+
+typedef struct ConvertEnvData
+{
+  bigint_policy bigIntPolicy;
+  napi_ref propertyKeys;
+  uint32_t propertyKeyCount;
+  property_key_cache_entry propertyKeyCache[PROPERTY_KEY_CACHE_SIZE];
+} convert_env_data;
+
+// Environment state read once per conversion rather than once per value: the cached key array and the BigInt policy
+typedef struct ConvertContext
+{
+  convert_env_data *envData;
+  napi_value propertyKeys;
+  bool allowBigInt;
+} convert_context;
+
+void initConvertEnvData(napi_env env);
+convert_context beginConvertContext(napi_env env);
+napi_value flStringToNapiPropertyKey(napi_env env, convert_context *context, FLString key);
+void setBigIntPolicy(napi_env env, bigint_policy policy);
+
 // Napi values to C variables
 bool isArray(napi_env env, napi_value value);
 bool napiValueToCBool(napi_env env, napi_value value);
+bool napiOptionToCBool(napi_env env, napi_value options, const char *name, bool *res);
 double napiValueToCDouble(napi_env env, napi_value value);
 int64_t napiValueToCInt64(napi_env env, napi_value value);
+bool napiValueToPositiveUInt32(napi_env env, napi_value value, uint32_t *res);
+bool napiOptionToPositiveUInt32(napi_env env, napi_value options, const char *name, uint32_t *res);
 
 // Napi values to Fleece objects
-FLString napiValueToFLString(napi_env env, napi_value value);
+FLString napiValueToFLString(napi_env env, napi_value value, convert_arena *arena);
 FLMutableDict napiValueToFLDict(napi_env env, napi_value object);
-FLMutableArray napiValueToFLArray(napi_env env, napi_value array);
+FLMutableDict napiValueToFLDictWithEncoder(napi_env env, FLEncoder enc, napi_value object, convert_arena *arena);
+FLDoc napiObjectToFLDoc(napi_env env, napi_value object);
+FLSliceResult napiValueToJSON(napi_env env, napi_value value);
+
+// Napi values streamed into a Fleece encoder
+void napiValueToFLEncoder(napi_env env, FLEncoder enc, napi_value value, convert_arena *arena);
+void napiObjectToFLEncoder(napi_env env, FLEncoder enc, napi_value object, convert_arena *arena);
+void napiArrayToFLEncoder(napi_env env, FLEncoder enc, napi_value array, convert_arena *arena);
+bool napiBinaryToFLEncoder(napi_env env, FLEncoder enc, napi_value value);
+void napiBigIntToFLEncoder(napi_env env, FLEncoder enc, napi_value value);
 
 // Fleece objects to Napi values
+napi_value flValueToNapiValue(napi_env env, FLValue value);
+napi_value flDataToNapiBuffer(napi_env env, FLValue value);
+napi_value flIntegerToNapiValue(napi_env env, FLValue value, bool allowBigInt);
 napi_value flDictToNapiValue(napi_env env, FLDict dict);
+napi_value flDictToFrozenNapiValue(napi_env env, FLDict dict);
 napi_value flArrayToNapiValue(napi_env env, FLArray array);
+
+// Encoded Fleece to a Napi ArrayBuffer that takes ownership of the slice
+napi_value flSliceResultToNapiArrayBuffer(napi_env env, FLSliceResult slice);
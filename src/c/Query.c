@@ -30,33 +30,36 @@ napi_value Database_CreateQuery(napi_env env, napi_callback_info info)
   CHECK(napi_typeof(env, args[1], &args1Type));
 
   CBLQuery *query;
+  convert_arena arena;
+  convertArena_Init(&arena);
 
   if (args1Type == napi_string)
   {
     // Assume N1QL
-    FLString queryString = napiValueToFLString(env, args[1]);
+    FLString queryString = napiValueToFLString(env, args[1], &arena);
 
     query = CBLDatabase_CreateQuery(databaseRef->database, kCBLN1QLLanguage, queryString, NULL, &err);
   }
   else if (args1Type == napi_object)
   {
     // Assume JSON
-    FLMutableArray jsonArray = napiValueToFLArray(env, args[1]);
-    FLString queryString = FLSliceResult_AsSlice(FLValue_ToJSON((FLValue)jsonArray));
-    FLMutableArray_Release(jsonArray);
+    FLSliceResult queryString = napiValueToJSON(env, args[1]);
 
-    query = CBLDatabase_CreateQuery(databaseRef->database, kCBLJSONLanguage, queryString, NULL, &err);
+    query = CBLDatabase_CreateQuery(databaseRef->database, kCBLJSONLanguage, FLSliceResult_AsSlice(queryString), NULL, &err);
+    FLSliceResult_Release(queryString);
   }
   else
   {
     // Use language passed in
     uint32_t language;
     CHECK(napi_get_value_uint32(env, args[1], &language));
-    FLString queryString = napiValueToFLString(env, args[2]);
+    FLString queryString = napiValueToFLString(env, args[2], &arena);
 
     query = CBLDatabase_CreateQuery(databaseRef->database, language, queryString, NULL, &err);
   }
 
+  convertArena_Free(&arena);
+
   if (!query)
   {
     throwCBLError(env, err);
@@ -114,6 +117,52 @@ napi_value Query_Execute(napi_env env, napi_callback_info info)
   return res;
 }
 
+// CBLQuery_Execute, with the results encoded as standalone Fleece
+napi_value Query_ExecuteFleece(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[argc];
+
+  CBLError err;
+
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_query_ref *queryRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&queryRef));
+  CBLQuery *query = queryRef->query;
+
+  CBLResultSet *results = CBLQuery_Execute(query, &err);
+
+  if (!results)
+  {
+    throwCBLError(env, err);
+    return NULL;
+  }
+
+  FLEncoder enc = FLEncoder_New();
+  FLEncoder_BeginArray(enc, 0);
+
+  while (CBLResultSet_Next(results))
+  {
+    FLEncoder_WriteValue(enc, (FLValue)CBLResultSet_ResultDict(results));
+  }
+
+  FLEncoder_EndArray(enc);
+  CBLResultSet_Release(results);
+
+  FLError encodeErr;
+  FLSliceResult data = FLEncoder_Finish(enc, &encodeErr);
+  FLEncoder_Free(enc);
+
+  if (!data.buf)
+  {
+    napi_throw_error(env, "", "Error encoding query results");
+    return NULL;
+  }
+
+  return flSliceResultToNapiArrayBuffer(env, data);
+}
+
 // CBLQuery_Explain
 napi_value Query_Explain(napi_env env, napi_callback_info info)
 {
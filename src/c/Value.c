@@ -0,0 +1,234 @@
+#include <assert.h>
+#include <node_api.h>
+#include <stdio.h>
+#include <string.h>
+#include "cbl/CouchbaseLite.h"
+#include "NapiConvert.h"
+#include "util.h"
+
+// Lets valueRefType tell value refs apart from any other external
+static const napi_type_tag valueRefTypeTag = {0x5c0a3e8d1f2b4c67, 0x9e41d7a2b3c85f10};
+
+static void finalize_value_external(napi_env env, void *data, void *hint)
+{
+  external_value_ref *valueRef = (external_value_ref *)data;
+
+  FLValue_Release(valueRef->value);
+  CBLDocument_Release(valueRef->document);
+  free(data);
+}
+
+static napi_value createValueRef(napi_env env, const CBLDocument *document, FLValue value)
+{
+  external_value_ref *valueRef = createExternalValueRef(document, value);
+
+  napi_value res;
+  CHECK(napi_create_external(env, valueRef, finalize_value_external, NULL, &res));
+  CHECK(napi_type_tag_object(env, res, &valueRefTypeTag));
+
+  return res;
+}
+
+// Converts scalars straight away, but only wraps dicts and arrays so they are decoded when they are accessed
+static napi_value flValueToLazyNapiValue(napi_env env, const CBLDocument *document, FLValue value)
+{
+  napi_value res;
+
+  if (value == NULL)
+  {
+    CHECK(napi_get_undefined(env, &res));
+    return res;
+  }
+
+  FLValueType type = FLValue_GetType(value);
+
+  if (type == kFLDict || type == kFLArray)
+  {
+    return createValueRef(env, document, value);
+  }
+
+  return flValueToNapiValue(env, value);
+}
+
+// CBLDocument_Properties, as a lazily decoded value ref
+napi_value Document_PropertiesRef(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_document_ref *docRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&docRef));
+  CBLDocument *doc = docRef->document;
+
+  return createValueRef(env, doc, (FLValue)CBLDocument_Properties(doc));
+}
+
+// FLDict_Get / FLArray_Get
+napi_value ValueRef_Get(napi_env env, napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_value_ref *valueRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&valueRef));
+
+  FLValue value = NULL;
+
+  if (FLValue_GetType(valueRef->value) == kFLArray)
+  {
+    uint32_t index;
+    CHECK(napi_get_value_uint32(env, args[1], &index));
+
+    value = FLArray_Get(FLValue_AsArray(valueRef->value), index);
+  }
+  else
+  {
+    convert_arena arena;
+    convertArena_Init(&arena);
+
+    FLString key = napiValueToFLString(env, args[1], &arena);
+    value = FLDict_Get(FLValue_AsDict(valueRef->value), key);
+
+    convertArena_Free(&arena);
+  }
+
+  return flValueToLazyNapiValue(env, valueRef->document, value);
+}
+
+// FLDict keys
+napi_value ValueRef_Keys(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_value_ref *valueRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&valueRef));
+
+  FLDict dict = FLValue_AsDict(valueRef->value);
+
+  napi_value res;
+  CHECK(napi_create_array_with_length(env, FLDict_Count(dict), &res));
+
+  convert_context context = beginConvertContext(env);
+
+  FLDictIterator iter;
+  FLDictIterator_Begin(dict, &iter);
+  uint32_t index = 0;
+
+  while (NULL != FLDictIterator_GetValue(&iter))
+  {
+    CHECK(napi_set_element(env, res, index++, flStringToNapiPropertyKey(env, &context, FLDictIterator_GetKeyString(&iter))));
+
+    FLDictIterator_Next(&iter);
+  }
+
+  return res;
+}
+
+// FLDict_Count / FLArray_Count
+napi_value ValueRef_Count(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  external_value_ref *valueRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&valueRef));
+
+  uint32_t count = FLValue_GetType(valueRef->value) == kFLArray
+                       ? FLArray_Count(FLValue_AsArray(valueRef->value))
+                       : FLDict_Count(FLValue_AsDict(valueRef->value));
+
+  napi_value res;
+  CHECK(napi_create_uint32(env, count, &res));
+
+  return res;
+}
+
+// 'dict' or 'array' for value refs, null for anything else
+napi_value ValueRef_Type(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  napi_value res;
+  CHECK(napi_get_null(env, &res));
+
+  napi_valuetype type;
+  CHECK(napi_typeof(env, args[0], &type));
+
+  if (type != napi_external)
+  {
+    return res;
+  }
+
+  bool isValueRef;
+  CHECK(napi_check_object_type_tag(env, args[0], &valueRefTypeTag, &isValueRef));
+
+  if (!isValueRef)
+  {
+    return res;
+  }
+
+  external_value_ref *valueRef;
+  CHECK(napi_get_value_external(env, args[0], (void *)&valueRef));
+
+  const char *name = FLValue_GetType(valueRef->value) == kFLArray ? "array" : "dict";
+  CHECK(napi_create_string_utf8(env, name, NAPI_AUTO_LENGTH, &res));
+
+  return res;
+}
+
+// How integers outside Number.MAX_SAFE_INTEGER are returned: 'unsafe' (as BigInts) or 'never' (as numbers)
+napi_value Value_SetBigIntPolicy(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  CHECK(napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  assertType(env, args[0], napi_string, "Wrong arguments: policy must be a string");
+
+  char policy[8];
+  CHECK(napi_get_value_string_utf8(env, args[0], policy, sizeof(policy), NULL));
+
+  if (strcmp(policy, "unsafe") == 0)
+  {
+    setBigIntPolicy(env, kBigIntPolicyUnsafe);
+  }
+  else if (strcmp(policy, "never") == 0)
+  {
+    setBigIntPolicy(env, kBigIntPolicyNever);
+  }
+  else
+  {
+    napi_throw_range_error(env, NULL, "Wrong arguments: policy must be 'unsafe' or 'never'");
+    return NULL;
+  }
+
+  napi_value res;
+  CHECK(napi_get_undefined(env, &res));
+
+  return res;
+}
+
+// Totals of the heap allocations made by conversions since the addon was loaded; used by the benchmarks only
+napi_value Value_ConvertAllocationStats(napi_env env, napi_callback_info info)
+{
+  convert_allocation_stats stats = convertAllocationStats();
+
+  napi_value res;
+  CHECK(napi_create_object(env, &res));
+
+  napi_value count;
+  CHECK(napi_create_double(env, (double)stats.count, &count));
+  CHECK(napi_set_named_property(env, res, "count", count));
+
+  napi_value bytes;
+  CHECK(napi_create_double(env, (double)stats.bytes, &bytes));
+  CHECK(napi_set_named_property(env, res, "bytes", bytes));
+
+  return res;
+}
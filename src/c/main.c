@@ -3,6 +3,7 @@
 #include "Document.c"
 #include "Query.c"
 #include "Replicator.c"
+#include "Value.c"
 
 #define DECLARE_NAPI_METHOD(name, func)     \
   {                                         \
@@ -11,6 +12,8 @@
 
 NAPI_MODULE_INIT(/* env, exports */)
 {
+  initConvertEnvData(env);
+
   napi_value CBLJSONLanguage;
   napi_create_uint32(env, kCBLJSONLanguage, &CBLJSONLanguage);
   napi_value CBLN1QLLanguage;
@@ -23,29 +26,65 @@ NAPI_MODULE_INIT(/* env, exports */)
       DECLARE_NAPI_METHOD("closeDatabase", Database_Close),
       DECLARE_NAPI_METHOD("deleteDatabase", Database_Delete),
       DECLARE_NAPI_METHOD("endTransaction", Database_EndTransaction),
+      DECLARE_NAPI_METHOD("transactionStats", Database_TransactionStats),
       DECLARE_NAPI_METHOD("openDatabase", Database_Open),
+      DECLARE_NAPI_METHOD("openDatabaseAsync", Database_OpenAsync),
       DECLARE_NAPI_METHOD("databaseName", Database_Name),
       DECLARE_NAPI_METHOD("databasePath", Database_Path),
+      DECLARE_NAPI_METHOD("performMaintenance", Database_PerformMaintenance),
+      DECLARE_NAPI_METHOD("databaseStats", Database_Stats),
+      DECLARE_NAPI_METHOD("enableDocumentCache", Database_EnableDocumentCache),
+      DECLARE_NAPI_METHOD("disableDocumentCache", Database_DisableDocumentCache),
+      DECLARE_NAPI_METHOD("documentCacheStats", Database_DocumentCacheStats),
 
       // Database document operations
       DECLARE_NAPI_METHOD("addDocumentChangeListener", Database_AddDocumentChangeListener),
       DECLARE_NAPI_METHOD("getDocument", Database_GetDocument),
       DECLARE_NAPI_METHOD("getMutableDocument", Database_GetMutableDocument),
       DECLARE_NAPI_METHOD("saveDocument", Database_SaveDocument),
+      DECLARE_NAPI_METHOD("putDocument", Database_PutDocument),
+      DECLARE_NAPI_METHOD("getDocumentPropertiesById", Database_GetDocumentPropertiesByID),
       DECLARE_NAPI_METHOD("deleteDocument", Database_DeleteDocument),
+      DECLARE_NAPI_METHOD("getDocumentAsync", Database_GetDocumentAsync),
+      DECLARE_NAPI_METHOD("getDocuments", Database_GetDocuments),
+      DECLARE_NAPI_METHOD("getDocumentsAsync", Database_GetDocumentsAsync),
+      DECLARE_NAPI_METHOD("getMutableDocumentAsync", Database_GetMutableDocumentAsync),
+      DECLARE_NAPI_METHOD("saveDocumentAsync", Database_SaveDocumentAsync),
+      DECLARE_NAPI_METHOD("saveDocuments", Database_SaveDocuments),
+      DECLARE_NAPI_METHOD("patchAndSave", Database_PatchAndSave),
+      DECLARE_NAPI_METHOD("deleteDocumentAsync", Database_DeleteDocumentAsync),
+      DECLARE_NAPI_METHOD("getDocumentExpiration", Database_GetDocumentExpiration),
+      DECLARE_NAPI_METHOD("setDocumentExpiration", Database_SetDocumentExpiration),
+      DECLARE_NAPI_METHOD("purgeDocuments", Database_PurgeDocuments),
 
       // Document operations
       DECLARE_NAPI_METHOD("createDocument", Document_Create),
+      DECLARE_NAPI_METHOD("compileKeyPath", KeyPath_Compile),
+      DECLARE_NAPI_METHOD("getDocumentFields", Document_Fields),
+      DECLARE_NAPI_METHOD("getDocumentFleece", Document_Fleece),
       DECLARE_NAPI_METHOD("getDocumentJSON", Document_CreateJSON),
       DECLARE_NAPI_METHOD("getDocumentID", Document_ID),
       DECLARE_NAPI_METHOD("getDocumentProperties", Document_Properties),
+      DECLARE_NAPI_METHOD("getDocumentRevisionID", Document_RevisionID),
+      DECLARE_NAPI_METHOD("getDocumentSequence", Document_Sequence),
+      DECLARE_NAPI_METHOD("patchDocument", Document_Patch),
       DECLARE_NAPI_METHOD("setDocumentJSON", Document_SetJSON),
       DECLARE_NAPI_METHOD("setDocumentProperties", Document_SetProperties),
 
+      // Values
+      DECLARE_NAPI_METHOD("getDocumentPropertiesRef", Document_PropertiesRef),
+      DECLARE_NAPI_METHOD("_convertAllocationStats", Value_ConvertAllocationStats),
+      DECLARE_NAPI_METHOD("setBigIntPolicy", Value_SetBigIntPolicy),
+      DECLARE_NAPI_METHOD("valueRefCount", ValueRef_Count),
+      DECLARE_NAPI_METHOD("valueRefGet", ValueRef_Get),
+      DECLARE_NAPI_METHOD("valueRefKeys", ValueRef_Keys),
+      DECLARE_NAPI_METHOD("valueRefType", ValueRef_Type),
+
       // Query
       DECLARE_NAPI_METHOD("createQuery", Database_CreateQuery),
       DECLARE_NAPI_METHOD("addQueryChangeListener", Query_AddChangeListener),
       DECLARE_NAPI_METHOD("executeQuery", Query_Execute),
+      DECLARE_NAPI_METHOD("executeQueryFleece", Query_ExecuteFleece),
       DECLARE_NAPI_METHOD("explainQuery", Query_Explain),
       DECLARE_NAPI_METHOD("getQueryParameters", Query_Parameters),
       DECLARE_NAPI_METHOD("setQueryParameters", Query_SetParameters),
@@ -49,6 +49,12 @@ external_database_ref *createExternalDatabaseRef(CBLDatabase *database)
   external_database_ref *databaseRef = malloc(sizeof(*databaseRef));
   databaseRef->database = database;
   databaseRef->isOpen = true;
+  databaseRef->documentCache = NULL;
+  databaseRef->stoppedDocumentCaches = NULL;
+  databaseRef->transactionDepth = 0;
+  databaseRef->transactionStart = 0;
+  databaseRef->transactionEnd = 0;
+  databaseRef->transactionOps = 0;
 
   return databaseRef;
 }
@@ -61,6 +67,14 @@ external_document_ref *createExternalDocumentRef(CBLDocument *document)
   return documentRef;
 }
 
+external_key_path_ref *createExternalKeyPathRef(FLKeyPath keyPath)
+{
+  external_key_path_ref *keyPathRef = malloc(sizeof(*keyPathRef));
+  keyPathRef->keyPath = keyPath;
+
+  return keyPathRef;
+}
+
 external_query_ref *createExternalQueryRef(CBLQuery *query)
 {
   external_query_ref *queryRef = malloc(sizeof(*queryRef));
@@ -77,6 +91,15 @@ external_replicator_ref *createExternalReplicatorRef(CBLReplicator *replicator)
   return replicatorRef;
 }
 
+external_value_ref *createExternalValueRef(const CBLDocument *document, FLValue value)
+{
+  external_value_ref *valueRef = malloc(sizeof(*valueRef));
+  valueRef->document = CBLDocument_Retain(document);
+  valueRef->value = FLValue_Retain(value);
+
+  return valueRef;
+}
+
 bool isDev()
 {
   return strcmp(getenv("NODE_ENV"), "dev") == 0 || strcmp(getenv("NODE_ENV"), "development") == 0;
@@ -136,15 +159,92 @@ void logFLStringToFile(FLString line)
   fclose(f);
 }
 
-void throwCBLError(napi_env env, CBLError err)
+napi_value createCBLError(napi_env env, CBLError err)
 {
   char code[20];
   sprintf(code, "%d", err.code);
 
   FLSliceResult errorMsg = CBLError_Message(&err);
-  char msg[errorMsg.size + 1];
-  assert(FLSlice_ToCString(FLSliceResult_AsSlice(errorMsg), msg, errorMsg.size + 1) == true);
+
+  napi_value napiCode;
+  napi_value napiMsg;
+  CHECK(napi_create_string_utf8(env, code, NAPI_AUTO_LENGTH, &napiCode));
+  CHECK(napi_create_string_utf8(env, errorMsg.buf, errorMsg.size, &napiMsg));
   FLSliceResult_Release(errorMsg);
 
-  assert(napi_throw_error(env, code, msg) == napi_ok);
+  napi_value res;
+  CHECK(napi_create_error(env, napiCode, napiMsg, &res));
+
+  return res;
+}
+
+void throwCBLError(napi_env env, CBLError err)
+{
+  assert(napi_throw(env, createCBLError(env, err)) == napi_ok);
+}
+
+napi_value createError(napi_env env, const char *msg)
+{
+  napi_value code;
+  napi_value napiMsg;
+  CHECK(napi_create_string_utf8(env, "", NAPI_AUTO_LENGTH, &code));
+  CHECK(napi_create_string_utf8(env, msg, NAPI_AUTO_LENGTH, &napiMsg));
+
+  napi_value res;
+  CHECK(napi_create_error(env, code, napiMsg, &res));
+
+  return res;
+}
+
+napi_value createRejectedPromise(napi_env env, const char *msg)
+{
+  napi_value promise;
+  napi_deferred deferred;
+  CHECK(napi_create_promise(env, &deferred, &promise));
+  CHECK(napi_reject_deferred(env, deferred, createError(env, msg)));
+
+  return promise;
+}
+
+// Turns the exception thrown by argument validation into a rejected Promise, so async functions never throw
+napi_value rejectPendingException(napi_env env)
+{
+  napi_value error;
+  CHECK(napi_get_and_clear_last_exception(env, &error));
+
+  napi_value promise;
+  napi_deferred deferred;
+  CHECK(napi_create_promise(env, &deferred, &promise));
+  CHECK(napi_reject_deferred(env, deferred, error));
+
+  return promise;
+}
+
+napi_value queueAsyncWork(napi_env env, const char *name, napi_async_execute_callback execute, napi_async_complete_callback complete, async_work_data *data)
+{
+  napi_value promise;
+  CHECK(napi_create_promise(env, &data->deferred, &promise));
+
+  data->err.code = 0;
+
+  napi_value resourceName;
+  CHECK(napi_create_string_utf8(env, name, NAPI_AUTO_LENGTH, &resourceName));
+  CHECK(napi_create_async_work(env, NULL, resourceName, execute, complete, data, &data->work));
+  CHECK(napi_queue_async_work(env, data->work));
+
+  return promise;
+}
+
+void finishAsyncWork(napi_env env, async_work_data *data, napi_value result)
+{
+  if (data->err.code != 0)
+  {
+    CHECK(napi_reject_deferred(env, data->deferred, createCBLError(env, data->err)));
+  }
+  else
+  {
+    CHECK(napi_resolve_deferred(env, data->deferred, result));
+  }
+
+  CHECK(napi_delete_async_work(env, data->work));
 }
\ No newline at end of file
@@ -34,6 +34,14 @@ typedef struct ExternalDatabaseRef
 {
   CBLDatabase *database;
   bool isOpen;
+  struct DocumentCache *documentCache; // NULL unless enabled with enableDocumentCache
+  struct DocumentCache *stoppedDocumentCaches; // replaced or disabled caches, freed once the database is closed
+  // Transactions begun through this ref and not yet ended. Start and end times (uv_hrtime) and the number of writes
+  // are those of the current or last outermost transaction.
+  uint32_t transactionDepth;
+  uint64_t transactionStart;
+  uint64_t transactionEnd;
+  uint64_t transactionOps;
 } external_database_ref;
 
 typedef struct ExternalDocumentRef
@@ -41,11 +49,22 @@ typedef struct ExternalDocumentRef
   CBLDocument *document;
 } external_document_ref;
 
+typedef struct ExternalKeyPathRef
+{
+  FLKeyPath keyPath;
+} external_key_path_ref;
+
 typedef struct ExternalQueryRef
 {
   CBLQuery *query;
 } external_query_ref;
 
+typedef struct ExternalValueRef
+{
+  const CBLDocument *document;
+  FLValue value;
+} external_value_ref;
+
 typedef struct ReplicationCallbacks
 {
   napi_threadsafe_function conflictResolver;
@@ -58,14 +77,25 @@ typedef struct ExternalReplicatorRef
   CBLReplicator *replicator;
 } external_replicator_ref;
 
+// Common state for operations that run CBL calls on a libuv worker thread and settle a Promise afterwards. Work
+// structs embed this as their first member; the execute callback records failures in err.
+typedef struct AsyncWorkData
+{
+  napi_async_work work;
+  napi_deferred deferred;
+  CBLError err;
+} async_work_data;
+
 void assertType(napi_env env, napi_value value, napi_valuetype type, char *errorMsg);
 external_blob_ref *createExternalBlobRef(CBLBlob *blob, bool releaseOnFinalize);
 external_blob_read_stream_ref *createExternalBlobReadStreamRef(CBLBlobReadStream *stream);
 external_blob_write_stream_ref *createExternalBlobWriteStreamRef(CBLBlobWriteStream *stream);
 external_database_ref *createExternalDatabaseRef(CBLDatabase *database);
 external_document_ref *createExternalDocumentRef(CBLDocument *document);
+external_key_path_ref *createExternalKeyPathRef(FLKeyPath keyPath);
 external_query_ref *createExternalQueryRef(CBLQuery *query);
 external_replicator_ref *createExternalReplicatorRef(CBLReplicator *replicator);
+external_value_ref *createExternalValueRef(const CBLDocument *document, FLValue value);
 bool isDev();
 bool isProd();
 bool isTest();
@@ -74,4 +104,10 @@ void logToFile(char *line);
 void logIntToFile(int32_t line);
 void logFloatToFile(double line);
 void logFLStringToFile(FLString line);
+napi_value createCBLError(napi_env env, CBLError err);
 void throwCBLError(napi_env env, CBLError err);
+napi_value createError(napi_env env, const char *msg);
+napi_value createRejectedPromise(napi_env env, const char *msg);
+napi_value rejectPendingException(napi_env env);
+napi_value queueAsyncWork(napi_env env, const char *name, napi_async_execute_callback execute, napi_async_complete_callback complete, async_work_data *data);
+void finishAsyncWork(napi_env env, async_work_data *data, napi_value result);
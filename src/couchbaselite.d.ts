@@ -1,7 +1,7 @@
 /* eslint-disable camelcase */
 
 declare module '*couchbaselite.node' {
-  import { BlobMetadata, BlobReadStreamRef, BlobRef, BlobWriteStreamRef, DatabaseChangeListener, DatabaseRef, DocumentChangeListener, DocumentRef, DocumentReplicationListener, MutableDocumentRef, QueryLanguage, QueryRef, RemoveDatabaseChangeListener, RemoveDocumentChangeListener, RemoveDocumentReplicationListener, RemoveQueryChangeListener, RemoveReplicatorChangeListener, ReplicatorChangeListener, ReplicatorConfiguration, ReplicatorRef, ReplicatorStatus } from 'src/types'
+  import { BlobMetadata, BlobReadStreamRef, BlobRef, BlobWriteStreamRef, DatabaseChangeListener, DatabaseRef, DatabaseStats, DocumentCacheStats, DocumentChangeListener, DocumentPatch, DocumentRef, DocumentReplicationListener, KeyPathRef, MaintenanceResult, MaintenanceType, MutableDocumentRef, QueryLanguage, QueryRef, RemoveDatabaseChangeListener, RemoveDocumentChangeListener, RemoveDocumentReplicationListener, RemoveQueryChangeListener, RemoveReplicatorChangeListener, ReplicatorChangeListener, ReplicatorConfiguration, ReplicatorRef, ReplicatorStatus, SaveDocumentOptions, SaveDocumentsEntry, SaveDocumentsResult, TransactionStats, ValueRef } from 'src/types'
 
   type QueryChangeListener<T> = (results: T[]) => void
 
@@ -30,28 +30,152 @@ declare module '*couchbaselite.node' {
     deleteDatabase(name: string, directory: string): boolean
     deleteDatabase(database: DatabaseRef): boolean
     endTransaction(database: DatabaseRef, commit: boolean): boolean
+    /**
+     * Depth, writes and duration of the transaction begun through this database ref, or of the last one once it has
+     * ended.
+     */
+    transactionStats(database: DatabaseRef): TransactionStats
     openDatabase(name: string, directory?: string): DatabaseRef
+    /**
+     * Open a database on a background thread. `warmup` N1QL queries are compiled and run to completion before the
+     * Promise resolves, so the first real request doesn't pay for cold caches. A failing warmup query closes the
+     * database and rejects.
+     */
+    openDatabaseAsync(name: string, directory?: string | null, options?: { warmup?: string[] }): Promise<DatabaseRef>
     databaseName(database: DatabaseRef): string
     databasePath(database: DatabaseRef): string
+    /**
+     * Run a maintenance task such as compaction on a background thread.
+     */
+    performMaintenance(database: DatabaseRef, type: MaintenanceType): Promise<MaintenanceResult>
+    /**
+     * Document count, last sequence and size on disk, cheap enough to poll for monitoring.
+     */
+    databaseStats(database: DatabaseRef): DatabaseStats
+    /**
+     * Keep up to `maxDocuments` (default 1000) recently read documents in memory, so repeated `getDocument` calls for
+     * the same ID skip the storage lookup. With `properties: true`, `getDocuments(..., { properties: true })` also
+     * caches each document's converted properties; those objects are shared between callers and frozen.
+     * Entries are dropped when documents change. Enabling again replaces the cache.
+     */
+    enableDocumentCache(database: DatabaseRef, options?: { maxDocuments?: number, properties?: boolean }): boolean
+    disableDocumentCache(database: DatabaseRef): boolean
+    /**
+     * The document cache's counters, or `null` if it isn't enabled.
+     */
+    documentCacheStats(database: DatabaseRef): DocumentCacheStats | null
 
     addDocumentChangeListener(database: DatabaseRef, docID: string, handler: DocumentChangeListener): RemoveDocumentChangeListener
     deleteDocument(database: DatabaseRef, doc: DocumentRef | MutableDocumentRef): boolean
     getDocument<T = unknown>(database: DatabaseRef, id: string): DocumentRef<T> | null
     getMutableDocument<T = unknown>(database: DatabaseRef, id: string): MutableDocumentRef<T> | null
-    saveDocument(database: DatabaseRef, doc: MutableDocumentRef): boolean
+    /**
+     * Save a document. Returns `false` if it conflicts with a concurrent save and `options` says to fail on conflicts.
+     */
+    saveDocument(database: DatabaseRef, doc: MutableDocumentRef, options?: SaveDocumentOptions): boolean
+    /**
+     * Save `properties` as the document `id` without creating a document ref. A stored document with the same ID is
+     * replaced, unless `options` says to fail on conflict (so the save only creates documents) or to merge.
+     */
+    putDocument<T = unknown>(database: DatabaseRef, id: string, properties: T, options?: SaveDocumentOptions): boolean
+    /**
+     * Read a document's properties without creating a document ref, or `null` if it doesn't exist. With the document
+     * cache's `properties` option enabled, the result is shared and frozen.
+     */
+    getDocumentPropertiesById<T = unknown>(database: DatabaseRef, id: string): T | null
+    deleteDocumentAsync(database: DatabaseRef, doc: DocumentRef | MutableDocumentRef): Promise<boolean>
+    getDocumentAsync<T = unknown>(database: DatabaseRef, id: string): Promise<DocumentRef<T> | null>
+    /**
+     * Get many documents in one call. The result is aligned with `ids`, with `null` for documents that don't exist.
+     * @param options.properties return each document's properties instead of a {@link @recouch/couchbase-lite#DocumentRef}.
+     */
+    getDocuments<T = unknown>(database: DatabaseRef, ids: string[], options?: { properties?: false }): (DocumentRef<T> | null)[]
+    getDocuments<T = unknown>(database: DatabaseRef, ids: string[], options: { properties: true }): (T | null)[]
+    getDocumentsAsync<T = unknown>(database: DatabaseRef, ids: string[], options?: { properties?: false }): Promise<(DocumentRef<T> | null)[]>
+    getDocumentsAsync<T = unknown>(database: DatabaseRef, ids: string[], options: { properties: true }): Promise<(T | null)[]>
+    getMutableDocumentAsync<T = unknown>(database: DatabaseRef, id: string): Promise<MutableDocumentRef<T> | null>
+    saveDocumentAsync(database: DatabaseRef, doc: MutableDocumentRef): Promise<boolean>
+    /**
+     * Set when a document expires and is purged, as a `Date` or milliseconds since the epoch. `null` clears it.
+     */
+    setDocumentExpiration(database: DatabaseRef, id: string, expiration: Date | number | null): boolean
+    /**
+     * When a document expires, or `null` if it doesn't.
+     */
+    getDocumentExpiration(database: DatabaseRef, id: string): Date | null
+    /**
+     * Purge many documents in a single transaction, leaving no tombstones. IDs that don't exist are skipped.
+     * Returns the number of documents purged.
+     */
+    purgeDocuments(database: DatabaseRef, ids: string[]): number
+    /**
+     * Patch a stored document and save it, retrying if another writer saves it in between. A missing document is
+     * created from the patch.
+     */
+    patchAndSave(database: DatabaseRef, id: string, patch: DocumentPatch): boolean
+    /**
+     * Create and save many documents, committing a transaction every `batchSize` documents (default 1000).
+     * Entries without an `id` get an auto-generated one. A failed entry doesn't stop the others; its result has
+     * `saved: false` and an `error`.
+     */
+    saveDocuments<T = unknown>(database: DatabaseRef, documents: SaveDocumentsEntry<T>[], options?: { batchSize?: number }): SaveDocumentsResult[]
     createDocument<T = unknown>(id?: string): MutableDocumentRef<T>
+    /**
+     * Compile a key path such as `'a.b'` or `'tags[0]'` once, for reuse with `getDocumentFields`.
+     */
+    compileKeyPath(path: string): KeyPathRef
+    /**
+     * Read selected fields of a document, converting only the matched values. The result is aligned with `paths`,
+     * with `undefined` for paths that don't match.
+     */
+    getDocumentFields<T extends unknown[] = unknown[]>(doc: DocumentRef | MutableDocumentRef, paths: (string | KeyPathRef)[]): T
+    getDocumentFleece(doc: DocumentRef | MutableDocumentRef): ArrayBuffer
     getDocumentJSON<T = unknown>(doc: DocumentRef<T> | MutableDocumentRef<T>): string
     getDocumentID(doc: DocumentRef | MutableDocumentRef): string
     getDocumentProperties<T = unknown>(doc: DocumentRef<T> | MutableDocumentRef<T>): T
+    /**
+     * The document's current revision ID, or `null` if it has never been saved. Suitable as an HTTP ETag.
+     */
+    getDocumentRevisionID(doc: DocumentRef | MutableDocumentRef): string | null
+    /**
+     * The document's sequence number, which increases every time it is saved; 0 if it has never been saved.
+     */
+    getDocumentSequence(doc: DocumentRef | MutableDocumentRef): number
+    /**
+     * The sequence number of a stored document, without converting its properties; `null` if it doesn't exist.
+     */
+    getDocumentSequence(database: DatabaseRef, id: string): number | null
+    /**
+     * Apply a merge patch to the document's properties in place, without converting the rest of the document.
+     * The document may be partly patched if an operation fails.
+     */
+    patchDocument(doc: MutableDocumentRef, patch: DocumentPatch): boolean
     setDocumentJSON<T = unknown>(doc: MutableDocumentRef<T>, value: string): boolean
     setDocumentProperties<T = unknown>(doc: MutableDocumentRef<T>, value: T): boolean
 
+    getDocumentPropertiesRef(doc: DocumentRef | MutableDocumentRef): ValueRef
+    /**
+     * Number and total size of the heap allocations made by conversions since the addon was loaded. For benchmarks;
+     * not part of the public API.
+     */
+    _convertAllocationStats(): { count: number, bytes: number }
+    /**
+     * Choose how integers outside `Number.MAX_SAFE_INTEGER` are returned.
+     * @param policy `'unsafe'` returns them as BigInts (default), `'never'` returns the nearest number.
+     */
+    setBigIntPolicy(policy: 'unsafe' | 'never'): void
+    valueRefCount(ref: ValueRef): number
+    valueRefGet(ref: ValueRef, key: string | number): unknown
+    valueRefKeys(ref: ValueRef): string[]
+    valueRefType(value: unknown): 'array' | 'dict' | null
+
     createQuery<T = unknown, P = Record<string, string>>(database: DatabaseRef, query: string): QueryRef<T, P>
     // eslint-disable-next-line @typescript-eslint/no-explicit-any
     createQuery<T = unknown, P = Record<string, string>>(database: DatabaseRef, query: any[]): QueryRef<T, P>
     createQuery<T = unknown, P = Record<string, string>>(database: DatabaseRef, queryLanguage: QueryLanguage, query: string): QueryRef<T, P>
     addQueryChangeListener<T = unknown, P = Record<string, string>>(query: QueryRef<T, P>, handler: QueryChangeListener<T>): RemoveQueryChangeListener
     executeQuery<T = unknown, P = Record<string, string>>(query: QueryRef<T, P>): T[]
+    executeQueryFleece<T = unknown, P = Record<string, string>>(query: QueryRef<T, P>): ArrayBuffer
     explainQuery<T = unknown, P = Record<string, string>>(query: QueryRef<T, P>): string
     getQueryParameters<T = unknown, P = Record<string, string>>(query: QueryRef<T, P>): Partial<P>
     setQueryParameters<T = unknown, P = Record<string, string>>(query: QueryRef<T, P>, parametersJSON: Partial<P>): void
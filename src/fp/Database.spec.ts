@@ -7,17 +7,28 @@ import {
   closeDatabase,
   databaseName,
   databasePath,
+  databaseStats,
   deleteDatabase,
+  disableDocumentCache,
+  documentCacheStats,
+  enableDocumentCache,
   endTransaction,
   openDatabase,
+  openDatabaseAsync,
+  performMaintenance,
+  putDocument,
   createDocument,
   getDocument,
   getDocumentID,
   getDocumentProperties,
+  getDocumentPropertiesById,
+  getDocuments,
+  getMutableDocument,
   saveDocument,
-  setDocumentProperties
+  setDocumentProperties,
+  transactionStats
 } from '../cblite'
-import { abortTransaction, commitTransaction } from './Database'
+import { abortTransaction, commitTransaction, createWriteCoalescer, runInTransaction } from './Database'
 import { createTestDatabase, testDirectory } from './test-util'
 
 describe('database functions', () => {
@@ -75,6 +86,23 @@ describe('database functions', () => {
     })
   })
 
+  describe('databaseStats', () => {
+    it('reports the document count, last sequence and file sizes', () => {
+      const { cleanup, db } = createTestDatabase({ doc1: { n: 1 }, doc2: { n: 2 } })
+
+      const stats = databaseStats(db)
+
+      expect(stats).toMatchObject({ count: 2, lastSequence: 2 })
+      expect(stats.fileSizes.sqlite).toBeGreaterThan(0)
+      expect(stats.fileSizes.total).toBeGreaterThanOrEqual(stats.fileSizes.sqlite + stats.fileSizes.wal + stats.fileSizes.shm + stats.fileSizes.attachments)
+
+      putDocument(db, 'doc3', { n: 3 })
+      expect(databaseStats(db)).toMatchObject({ count: 3, lastSequence: 3 })
+
+      cleanup()
+    })
+  })
+
   describe('deleteDatabase', () => {
     it('deletes the database by reference', () => {
       const { cleanup, db, dbPath } = createTestDatabase()
@@ -139,6 +167,123 @@ describe('database functions', () => {
     })
   })
 
+  describe('enableDocumentCache', () => {
+    it('serves repeated lookups from the cache', () => {
+      const { cleanup, db } = createTestDatabase({ doc1: { name: 'one' } })
+
+      expect(documentCacheStats(db)).toBeNull()
+      expect(enableDocumentCache(db)).toBe(true)
+
+      expect(getDocumentProperties(getDocument(db, 'doc1')!)).toEqual({ name: 'one' })
+      expect(getDocumentProperties(getDocument(db, 'doc1')!)).toEqual({ name: 'one' })
+      expect(getDocument(db, 'missing')).toBeNull()
+      expect(documentCacheStats(db)).toEqual({ hits: 1, misses: 2, evictions: 0, invalidations: 0, count: 1, capacity: 1000 })
+
+      expect(disableDocumentCache(db)).toBe(true)
+      expect(documentCacheStats(db)).toBeNull()
+
+      cleanup()
+    })
+
+    it('drops documents when they are saved', () => {
+      const { cleanup, db } = createTestDatabase({ doc1: { name: 'one' } })
+
+      enableDocumentCache(db)
+      getDocument(db, 'doc1')
+
+      const doc = getMutableDocument(db, 'doc1')!
+      setDocumentProperties(doc, { name: 'uno' })
+      saveDocument(db, doc)
+
+      expect(getDocumentProperties(getDocument(db, 'doc1')!)).toEqual({ name: 'uno' })
+      expect(documentCacheStats(db)).toMatchObject({ hits: 0, misses: 2, invalidations: 1 })
+
+      cleanup()
+    })
+
+    it('evicts the least recently used document', () => {
+      const { cleanup, db } = createTestDatabase({ doc1: { n: 1 }, doc2: { n: 2 }, doc3: { n: 3 } })
+
+      enableDocumentCache(db, { maxDocuments: 2 })
+      getDocument(db, 'doc1')
+      getDocument(db, 'doc2')
+      getDocument(db, 'doc1')
+      getDocument(db, 'doc3')
+      getDocument(db, 'doc1')
+
+      expect(documentCacheStats(db)).toMatchObject({ hits: 2, misses: 3, evictions: 1, count: 2, capacity: 2 })
+
+      getDocument(db, 'doc2')
+      expect(documentCacheStats(db)).toMatchObject({ misses: 4, evictions: 2 })
+
+      // Leaving out `properties` must not cache converted properties
+      expect(Object.isFrozen(getDocuments(db, ['doc1'], { properties: true })[0])).toBe(false)
+
+      expect(() => enableDocumentCache(db, { maxDocuments: 0 })).toThrow(RangeError)
+      expect(() => enableDocumentCache(db, { maxDocuments: 1.5 })).toThrow(RangeError)
+      expect(() => enableDocumentCache(db, { maxDocuments: 2 ** 32 })).toThrow(RangeError)
+      expect(() => enableDocumentCache(db, { maxDocuments: '2' as unknown as number })).toThrow(TypeError)
+      expect(() => enableDocumentCache(db, { properties: 'yes' as unknown as boolean })).toThrow(TypeError)
+
+      cleanup()
+    })
+
+    it('shares frozen properties between lookups', () => {
+      const { cleanup, db } = createTestDatabase({ doc1: { name: 'one', tags: ['a'] } })
+
+      enableDocumentCache(db, { properties: true })
+
+      const [first] = getDocuments<{ name: string, tags: string[] }>(db, ['doc1', 'missing'], { properties: true })
+      const [second, missing] = getDocuments<{ name: string, tags: string[] }>(db, ['doc1', 'missing'], { properties: true })
+
+      expect(second).toBe(first)
+      expect(second).toEqual({ name: 'one', tags: ['a'] })
+      expect(missing).toBeNull()
+      expect(Object.isFrozen(first)).toBe(true)
+      expect(Object.isFrozen(first!.tags)).toBe(true)
+
+      const doc = getMutableDocument(db, 'doc1')!
+      setDocumentProperties(doc, { name: 'uno', tags: [] })
+      saveDocument(db, doc)
+
+      expect(getDocuments(db, ['doc1'], { properties: true })).toEqual([{ name: 'uno', tags: [] }])
+
+      cleanup()
+    })
+  })
+
+  describe('performMaintenance', () => {
+    it('compacts the database and reports its size', async () => {
+      const { cleanup, db } = createTestDatabase({ doc1: { name: 'one' } })
+
+      const result = await performMaintenance(db, 'compact')
+
+      expect(result).toEqual({
+        type: 'compact',
+        before: expect.objectContaining({ total: expect.any(Number), sqlite: expect.any(Number) }),
+        after: expect.objectContaining({ total: expect.any(Number), sqlite: expect.any(Number) }),
+        durationMs: expect.any(Number)
+      })
+      expect(result.after.sqlite).toBeGreaterThan(0)
+      expect(result.after.total).toBeGreaterThanOrEqual(result.after.sqlite + result.after.wal + result.after.shm)
+
+      await expect(performMaintenance(db, 'integrityCheck')).resolves.toMatchObject({ type: 'integrityCheck' })
+      await expect(performMaintenance(db, 'vacuum' as never)).rejects.toThrow(TypeError)
+
+      cleanup()
+    })
+
+    it('rejects when the database is closed', async () => {
+      const { db, dbName } = createTestDatabase()
+
+      closeDatabase(db)
+
+      await expect(performMaintenance(db, 'optimize')).rejects.toThrow('Database is closed')
+
+      deleteDatabase(dbName, testDirectory)
+    })
+  })
+
   describe('openDatabase', () => {
     it('creates a new database on disk', () => {
       const db = openDatabase('new_db')
@@ -162,6 +307,57 @@ describe('database functions', () => {
     })
   })
 
+  describe('openDatabaseAsync', () => {
+    it('opens a database on a background thread', async () => {
+      const { cleanup, db, dbName } = createTestDatabase({ doc1: { type: 'child' } })
+
+      const db2 = await openDatabaseAsync(dbName, testDirectory, { warmup: ['SELECT * FROM _ WHERE type == "child"'] })
+
+      expect(databaseName(db2)).toBe(dbName)
+      expect(getDocumentPropertiesById(db2, 'doc1')).toEqual({ type: 'child' })
+
+      closeDatabase(db2)
+      cleanup()
+    })
+
+    it('accepts paths longer than 128 bytes', async () => {
+      const directory = join(testDirectory, 'a'.repeat(150))
+      const dbName = `db-${'b'.repeat(150)}`
+      fs.mkdirSync(directory, { recursive: true })
+
+      const db = await openDatabaseAsync(dbName, directory)
+
+      expect(databaseName(db)).toBe(dbName)
+      expect(databasePath(db)).toContain(directory)
+
+      closeDatabase(db)
+      expect(deleteDatabase(dbName, directory)).toBe(true)
+
+      const syncDb = openDatabase(dbName, directory)
+      expect(databaseName(syncDb)).toBe(dbName)
+      deleteDatabase(syncDb)
+
+      fs.rmSync(directory, { recursive: true, force: true })
+    })
+
+    it('rejects when a warmup query fails', async () => {
+      const dbName = `tmp-db-${nanoid()}`
+
+      await expect(openDatabaseAsync(dbName, testDirectory, { warmup: ['SELECT * FROM *'] })).rejects.toThrow('N1QL syntax error')
+
+      deleteDatabase(dbName, testDirectory)
+    })
+
+    it('rejects invalid arguments instead of throwing', async () => {
+      const dbName = `tmp-db-${nanoid()}`
+
+      await expect(openDatabaseAsync(42 as never)).rejects.toThrow(new TypeError('Wrong arguments: database name must be a string'))
+      await expect(openDatabaseAsync(dbName, 42 as never)).rejects.toThrow(new TypeError('Wrong arguments: directory must be a string'))
+      await expect(openDatabaseAsync(dbName, testDirectory, { warmup: 'SELECT 1' as never })).rejects.toThrow(TypeError)
+      await expect(openDatabaseAsync(dbName, testDirectory, { warmup: [1] as never })).rejects.toThrow(TypeError)
+    })
+  })
+
   describe('beginTransaction/endTransaction', () => {
     it('commits all changes at once when committing a transaction', () => {
       const { cleanup, db, dbName } = createTestDatabase()
@@ -295,4 +491,159 @@ describe('database functions', () => {
       cleanup()
     })
   })
+
+  describe('createWriteCoalescer', () => {
+    it('commits queued writes together after maxDelay', async () => {
+      const { cleanup, db } = createTestDatabase()
+      const coalescer = createWriteCoalescer(db, { maxDelay: 10 })
+      const doc = createDocument('doc2')
+      setDocumentProperties(doc, { name: 'two' })
+
+      const writes = [coalescer.put('doc1', { name: 'one' }), coalescer.save(doc)]
+
+      expect(getDocument(db, 'doc1')).toBeNull()
+      expect(getDocument(db, 'doc2')).toBeNull()
+
+      expect(await Promise.all(writes)).toEqual([true, true])
+      expect(getDocumentPropertiesById(db, 'doc1')).toEqual({ name: 'one' })
+      expect(getDocumentPropertiesById(db, 'doc2')).toEqual({ name: 'two' })
+
+      cleanup()
+    })
+
+    it('commits as soon as maxOps writes are queued', async () => {
+      const { cleanup, db } = createTestDatabase()
+      const coalescer = createWriteCoalescer(db, { maxOps: 2, maxDelay: 1000 })
+
+      const first = coalescer.put('doc1', { n: 1 })
+      expect(getDocument(db, 'doc1')).toBeNull()
+
+      const second = coalescer.put('doc2', { n: 2 })
+      expect(getDocumentPropertiesById(db, 'doc1')).toEqual({ n: 1 })
+      expect(getDocumentPropertiesById(db, 'doc2')).toEqual({ n: 2 })
+
+      expect(await Promise.all([first, second])).toEqual([true, true])
+
+      cleanup()
+    })
+
+    it('rejects only the writes that fail', async () => {
+      const { cleanup, db } = createTestDatabase({ doc1: { n: 1 } })
+      const coalescer = createWriteCoalescer(db)
+
+      const conflicting = coalescer.put('doc1', { n: 2 }, { concurrency: 'failOnConflict' })
+      const invalid = coalescer.put('doc2', { n: 2 }, { concurrency: 'sometimes' } as never)
+      const valid = coalescer.put('doc3', { n: 3 })
+
+      await coalescer.flush()
+
+      await expect(conflicting).resolves.toBe(false)
+      await expect(invalid).rejects.toThrow(TypeError)
+      await expect(valid).resolves.toBe(true)
+      expect(getDocument(db, 'doc2')).toBeNull()
+      expect(getDocumentPropertiesById(db, 'doc3')).toEqual({ n: 3 })
+
+      cleanup()
+    })
+  })
+
+  describe('runInTransaction', () => {
+    it('commits when the callback returns', () => {
+      const { cleanup, db, dbName } = createTestDatabase()
+      const db2 = openDatabase(dbName, testDirectory)
+      const onComplete = jest.fn()
+
+      const result = runInTransaction(db, () => {
+        putDocument(db, 'doc1', { name: 'one' })
+        putDocument(db, 'doc2', { name: 'two' })
+
+        expect(getDocument(db2, 'doc1')).toBeNull()
+        expect(transactionStats(db)).toMatchObject({ depth: 1, ops: 2 })
+
+        return 'done'
+      }, { onComplete })
+
+      expect(result).toBe('done')
+      expect(getDocumentPropertiesById(db2, 'doc1')).toEqual({ name: 'one' })
+      expect(onComplete).toHaveBeenCalledTimes(1)
+      expect(onComplete).toHaveBeenCalledWith({ depth: 0, ops: 2, durationMs: expect.any(Number), committed: true })
+
+      closeDatabase(db2)
+      cleanup()
+    })
+
+    it('rolls back and rethrows when the callback throws', () => {
+      const { cleanup, db } = createTestDatabase()
+      const onComplete = jest.fn()
+      const error = new Error('failed')
+
+      expect(() => runInTransaction(db, () => {
+        putDocument(db, 'doc1', { name: 'one' })
+
+        throw error
+      }, { onComplete })).toThrow(error)
+
+      expect(getDocument(db, 'doc1')).toBeNull()
+      expect(transactionStats(db).depth).toBe(0)
+      expect(onComplete).toHaveBeenCalledWith(expect.objectContaining({ ops: 1, committed: false }))
+
+      cleanup()
+    })
+
+    it('joins an outer transaction when nested', () => {
+      const { cleanup, db, dbName } = createTestDatabase()
+      const db2 = openDatabase(dbName, testDirectory)
+      const onInnerComplete = jest.fn()
+
+      runInTransaction(db, () => {
+        putDocument(db, 'doc1', { name: 'one' })
+
+        runInTransaction(db, () => {
+          expect(transactionStats(db).depth).toBe(2)
+          putDocument(db, 'doc2', { name: 'two' })
+        }, { onComplete: onInnerComplete })
+
+        expect(getDocument(db2, 'doc2')).toBeNull()
+      })
+
+      expect(onInnerComplete).not.toHaveBeenCalled()
+      expect(transactionStats(db)).toMatchObject({ depth: 0, ops: 2 })
+      expect(getDocumentPropertiesById(db2, 'doc2')).toEqual({ name: 'two' })
+
+      putDocument(db, 'doc3', { name: 'three' })
+      expect(transactionStats(db).ops).toBe(2)
+
+      closeDatabase(db2)
+      cleanup()
+    })
+
+    it('commits the writes of a nested call that threw if the outer callback catches the error', () => {
+      const { cleanup, db } = createTestDatabase()
+
+      runInTransaction(db, () => {
+        try {
+          runInTransaction(db, () => {
+            putDocument(db, 'doc1', { name: 'one' })
+
+            throw new Error('failed')
+          })
+        } catch {
+          // Swallowed, so the outer transaction commits
+        }
+      })
+
+      expect(getDocumentPropertiesById(db, 'doc1')).toEqual({ name: 'one' })
+
+      cleanup()
+    })
+
+    it('rejects asynchronous callbacks', () => {
+      const { cleanup, db } = createTestDatabase()
+
+      expect(() => runInTransaction(db, async () => putDocument(db, 'doc1', {}))).toThrow(TypeError)
+      expect(transactionStats(db).depth).toBe(0)
+
+      cleanup()
+    })
+  })
 })
@@ -1,5 +1,142 @@
-import { endTransaction } from '../cblite'
-import { DatabaseRef } from '../types'
+import { beginTransaction, endTransaction, putDocument, saveDocument, transactionStats } from '../cblite'
+import { DatabaseRef, MutableDocumentRef, SaveDocumentOptions, TransactionStats } from '../types'
 
 export const abortTransaction = (database: DatabaseRef) => endTransaction(database, false)
 export const commitTransaction = (database: DatabaseRef) => endTransaction(database, true)
+
+export interface RunInTransactionOptions {
+  /** Called once the outermost transaction has ended, with its writes and duration. Ignored by nested calls. */
+  onComplete?: (stats: TransactionStats & { committed: boolean }) => void
+}
+
+const reportCompletion = (database: DatabaseRef, committed: boolean, onComplete: RunInTransactionOptions['onComplete']) => {
+  if (!onComplete) return
+
+  const stats = transactionStats(database)
+
+  if (stats.depth === 0) onComplete({ ...stats, committed })
+}
+
+/**
+ * Run `fn` in a transaction, committing if it returns and rolling back if it throws. Calls nest: an inner call joins
+ * the outer transaction, and nothing is committed until the outermost call returns. `fn` must be synchronous, since
+ * an open transaction would otherwise block other writers across event loop turns.
+ *
+ * Only the outermost call can roll back. When a nested `fn` throws, its writes stay in the outer transaction, so an
+ * outer `fn` that catches the error commits them; let the error propagate to discard them.
+ */
+export const runInTransaction = <T>(database: DatabaseRef, fn: () => T, { onComplete }: RunInTransactionOptions = {}): T => {
+  beginTransaction(database)
+
+  let result: T
+
+  try {
+    result = fn()
+
+    if (typeof (result as unknown as PromiseLike<unknown>)?.then === 'function') {
+      throw new TypeError('runInTransaction callbacks must be synchronous')
+    }
+  } catch (error) {
+    endTransaction(database, false)
+    reportCompletion(database, false, onComplete)
+
+    throw error
+  }
+
+  endTransaction(database, true)
+  reportCompletion(database, true, onComplete)
+
+  return result
+}
+
+export interface WriteCoalescerOptions {
+  /** Commit once this many writes are queued (default 100) */
+  maxOps?: number
+  /** Commit at most this many milliseconds after the first write is queued (default 5) */
+  maxDelay?: number
+}
+
+export interface WriteCoalescer {
+  /** Queue a `saveDocument`. Resolves with its result once the group it belongs to is committed. */
+  save(doc: MutableDocumentRef, options?: SaveDocumentOptions): Promise<boolean>
+  /** Queue a `putDocument`. Resolves with its result once the group it belongs to is committed. */
+  put<T = unknown>(id: string, properties: T, options?: SaveDocumentOptions): Promise<boolean>
+  /** Commit the queued writes now */
+  flush(): Promise<void>
+}
+
+interface QueuedWrite {
+  write: () => boolean
+  resolve: (saved: boolean) => void
+  reject: (error: unknown) => void
+}
+
+/**
+ * Group commit: writes queued from independent callers are applied together in one transaction, so they share a
+ * single commit instead of paying for one each. The transaction is only open while a group is being written, never
+ * across event loop turns, so other code using the database is unaffected.
+ *
+ * A write that throws rejects only its own Promise. If the commit itself fails, every write in the group is rejected.
+ * Documents passed to `save` must not be modified until their Promise settles.
+ */
+export const createWriteCoalescer = (database: DatabaseRef, { maxOps = 100, maxDelay = 5 }: WriteCoalescerOptions = {}): WriteCoalescer => {
+  if (!(maxOps >= 1)) throw new RangeError('maxOps must be at least 1')
+  if (!(maxDelay >= 0)) throw new RangeError('maxDelay must not be negative')
+
+  let queue: QueuedWrite[] = []
+  let timer: ReturnType<typeof setTimeout> | undefined
+
+  const commit = () => {
+    if (timer !== undefined) clearTimeout(timer)
+    timer = undefined
+
+    const group = queue
+    queue = []
+
+    if (group.length === 0) return
+
+    const results: { saved?: boolean, error?: unknown }[] = []
+
+    try {
+      beginTransaction(database)
+    } catch (error) {
+      group.forEach(({ reject }) => reject(error))
+      return
+    }
+
+    for (const { write } of group) {
+      try {
+        results.push({ saved: write() })
+      } catch (error) {
+        results.push({ error })
+      }
+    }
+
+    try {
+      endTransaction(database, true)
+    } catch (error) {
+      group.forEach(({ reject }) => reject(error))
+      return
+    }
+
+    group.forEach(({ resolve, reject }, i) => {
+      const result = results[i]
+
+      if ('error' in result) reject(result.error)
+      else resolve(result.saved!)
+    })
+  }
+
+  const enqueue = (write: () => boolean) => new Promise<boolean>((resolve, reject) => {
+    queue.push({ write, resolve, reject })
+
+    if (queue.length >= maxOps) commit()
+    else if (timer === undefined) timer = setTimeout(commit, maxDelay)
+  })
+
+  return {
+    save: (doc, options) => enqueue(() => saveDocument(database, doc, options)),
+    put: (id, properties, options) => enqueue(() => putDocument(database, id, properties, options)),
+    flush: async () => commit()
+  }
+}
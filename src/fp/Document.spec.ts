@@ -1,4 +1,5 @@
-import { closeDatabase, addDocumentChangeListener, createDocument, deleteDocument, getDocument, getDocumentID, getDocumentJSON, getDocumentProperties, getMutableDocument, saveDocument, setDocumentJSON, setDocumentProperties } from '../cblite'
+import { closeDatabase, addDocumentChangeListener, compileKeyPath, createDocument, deleteDocument, deleteDocumentAsync, getDocument, getDocumentAsync, getDocumentExpiration, getDocumentFields, getDocumentID, getDocumentJSON, getDocumentProperties, getDocumentPropertiesById, getDocumentRevisionID, getDocumentSequence, getDocuments, getDocumentsAsync, getMutableDocument, getMutableDocumentAsync, patchAndSave, patchDocument, purgeDocuments, putDocument, saveDocument, saveDocumentAsync, saveDocuments, setBigIntPolicy, setDocumentExpiration, setDocumentJSON, setDocumentProperties } from '../cblite'
+import { getLazyDocumentProperties, patchAppend, patchIncrement, patchRemove } from './Document'
 import { createTestDatabase } from './test-util'
 
 describe('document functions', () => {
@@ -73,6 +74,25 @@ describe('document functions', () => {
     })
   })
 
+  describe('deleteDocumentAsync', () => {
+    it('deletes a document', async () => {
+      const { cleanup, db } = createTestDatabase({ 'test-1': { hello: 'world' } })
+
+      await expect(deleteDocumentAsync(db, getMutableDocument(db, 'test-1')!)).resolves.toBe(true)
+      expect(getDocument(db, 'test-1')).toBeNull()
+
+      cleanup()
+    })
+
+    it('rejects when trying to delete an unsaved document', async () => {
+      const { cleanup, db } = createTestDatabase()
+
+      await expect(deleteDocumentAsync(db, createDocument())).rejects.toThrow()
+
+      cleanup()
+    })
+  })
+
   describe('getDocument', () => {
     it('gets a non-mutable document by ID from the database', () => {
       const { cleanup, db } = createTestDatabase({ boy: { name: 'Milo' } })
@@ -102,6 +122,143 @@ describe('document functions', () => {
     })
   })
 
+  describe('getDocumentAsync', () => {
+    it('gets a document by ID from the database', async () => {
+      const { cleanup, db } = createTestDatabase({ boy: { name: 'Milo' } })
+
+      const doc = await getDocumentAsync<{ name: string }>(db, 'boy')
+      expect(getDocumentProperties(doc!).name).toBe('Milo')
+
+      const mutableDoc = await getMutableDocumentAsync<{ name: string }>(db, 'boy')
+      setDocumentProperties(mutableDoc!, { name: 'Max' })
+      expect(getDocumentProperties(mutableDoc!).name).toBe('Max')
+
+      cleanup()
+    })
+
+    it('resolves to null when document is not found', async () => {
+      const { cleanup, db } = createTestDatabase({ boy: { name: 'Milo' } })
+
+      await expect(getDocumentAsync(db, 'girl')).resolves.toBeNull()
+
+      cleanup()
+    })
+
+    it('rejects on a closed database', async () => {
+      const { cleanup, db } = createTestDatabase({ boy: { name: 'Milo' } })
+
+      closeDatabase(db)
+      await expect(getDocumentAsync(db, 'boy')).rejects.toThrowError('Database is closed')
+
+      cleanup()
+    })
+  })
+
+  describe('getDocuments', () => {
+    it('gets many documents in one call, with null for missing ones', () => {
+      const { cleanup, db } = createTestDatabase({ boy: { name: 'Milo' }, girl: { name: 'Polly' } })
+
+      const docs = getDocuments<{ name: string }>(db, ['girl', 'nobody', 'boy'])
+      expect(docs.map(doc => doc && getDocumentProperties(doc).name)).toEqual(['Polly', null, 'Milo'])
+      expect(getDocuments(db, ['boy', 'nobody'], { properties: true })).toEqual([{ name: 'Milo' }, null])
+
+      cleanup()
+    })
+
+    it('gets documents off the JS thread', async () => {
+      const { cleanup, db } = createTestDatabase({ boy: { name: 'Milo' }, girl: { name: 'Polly' } })
+
+      await expect(getDocumentsAsync(db, ['girl', 'nobody', 'boy'], { properties: true })).resolves.toEqual([{ name: 'Polly' }, null, { name: 'Milo' }])
+
+      cleanup()
+    })
+
+    it('returns document refs when the properties option is left out', async () => {
+      const { cleanup, db } = createTestDatabase({ boy: { name: 'Milo' } })
+
+      expect(getDocumentID(getDocuments(db, ['boy'], {})[0]!)).toBe('boy')
+      expect(getDocumentID((await getDocumentsAsync(db, ['boy'], {}))[0]!)).toBe('boy')
+
+      cleanup()
+    })
+
+    it('rejects invalid IDs instead of throwing', async () => {
+      const { cleanup, db } = createTestDatabase()
+
+      await expect(getDocumentsAsync(db, [1 as unknown as string])).rejects.toThrowError(new TypeError('Wrong arguments: document IDs must be strings'))
+      await expect(getDocumentsAsync(db, 'boy' as unknown as string[])).rejects.toThrowError(new TypeError('Wrong arguments: document IDs must be an array'))
+      await expect(getDocumentsAsync(db, [], { properties: 'yes' as unknown as true })).rejects.toThrowError(new TypeError('Wrong arguments: properties must be a boolean'))
+      expect(() => getDocuments(db, [], { properties: 1 as unknown as true })).toThrowError(TypeError)
+
+      cleanup()
+    })
+
+    it('rejects IDs that are not strings', () => {
+      const { cleanup, db } = createTestDatabase()
+
+      expect(() => getDocuments(db, [1 as unknown as string])).toThrowError('Wrong arguments: document IDs must be strings')
+
+      cleanup()
+    })
+  })
+
+  describe('getDocumentExpiration/setDocumentExpiration', () => {
+    it('sets and clears a document expiration', () => {
+      const { cleanup, db } = createTestDatabase({ testDoc: { session: 'abc' } })
+      const expiration = new Date(Date.now() + 60 * 60 * 1000)
+
+      expect(getDocumentExpiration(db, 'testDoc')).toBeNull()
+
+      expect(setDocumentExpiration(db, 'testDoc', expiration)).toBe(true)
+      expect(getDocumentExpiration(db, 'testDoc')).toEqual(expiration)
+
+      expect(setDocumentExpiration(db, 'testDoc', expiration.getTime() + 1000)).toBe(true)
+      expect(getDocumentExpiration(db, 'testDoc')!.getTime()).toBe(expiration.getTime() + 1000)
+
+      expect(setDocumentExpiration(db, 'testDoc', null)).toBe(true)
+      expect(getDocumentExpiration(db, 'testDoc')).toBeNull()
+
+      expect(() => setDocumentExpiration(db, 'testDoc', 'tomorrow' as never)).toThrow(TypeError)
+      expect(() => setDocumentExpiration(db, 'testDoc', -1)).toThrow(RangeError)
+      expect(() => setDocumentExpiration(db, 'testDoc', Infinity)).toThrow(RangeError)
+      expect(() => setDocumentExpiration(db, 'testDoc', 2 ** 63)).toThrow(RangeError)
+      expect(() => setDocumentExpiration(db, 'testDoc', new Date(NaN))).toThrow(RangeError)
+
+      cleanup()
+    })
+  })
+
+  describe('getDocumentFields', () => {
+    it('reads only the selected fields', () => {
+      const { cleanup, db } = createTestDatabase({
+        post: { title: 'Hello', meta: { updated: 1650000000, author: { name: 'Milo' } }, tags: ['news', 'kids'] }
+      })
+      const doc = getDocument(db, 'post')!
+
+      expect(getDocumentFields(doc, ['meta.author.name', 'tags[1]', 'meta', 'missing.field'])).toEqual([
+        'Milo',
+        'kids',
+        { updated: 1650000000, author: { name: 'Milo' } },
+        undefined
+      ])
+
+      cleanup()
+    })
+
+    it('accepts compiled key paths', () => {
+      const { cleanup, db } = createTestDatabase({ a: { meta: { updated: 1 } }, b: { meta: { updated: 2 } } })
+      const updated = compileKeyPath('meta.updated')
+
+      expect(['a', 'b'].map(id => getDocumentFields(getDocument(db, id)!, [updated, 'meta'])[0])).toEqual([1, 2])
+
+      cleanup()
+    })
+
+    it('rejects invalid key paths', () => {
+      expect(() => compileKeyPath('tags[')).toThrowError('Invalid key path: tags[')
+    })
+  })
+
   describe('getDocumentID', () => {
     it('returns the ID of the document', () => {
       const { cleanup, db } = createTestDatabase({ child: {} })
@@ -165,8 +322,341 @@ describe('document functions', () => {
       }
       const { cleanup, db } = createTestDatabase({ person })
 
+      // Integers within the safe range come back as numbers, even when they were saved as BigInts
       const doc = getDocument(db, 'person')!
-      expect(getDocumentProperties(doc)).toEqual(person)
+      expect(getDocumentProperties(doc)).toEqual({
+        ...person,
+        children: person.children.map(child => typeof child === 'bigint' ? Number(child) : child)
+      })
+
+      cleanup()
+    })
+
+    it('returns integers in the safe range as numbers', () => {
+      const numbers = {
+        negative: -5,
+        large: 3000000000,
+        negativeLarge: -3000000000,
+        maxSafe: Number.MAX_SAFE_INTEGER,
+        minSafe: Number.MIN_SAFE_INTEGER,
+        fraction: -0.5,
+        unsafe: BigInt(Number.MAX_SAFE_INTEGER) + BigInt(1),
+        negativeUnsafe: -BigInt(Number.MAX_SAFE_INTEGER) - BigInt(1),
+        maxUInt64: BigInt('18446744073709551615')
+      }
+      const { cleanup, db } = createTestDatabase({ numbers })
+
+      expect(getDocumentProperties(getDocument(db, 'numbers')!)).toEqual(numbers)
+
+      cleanup()
+    })
+
+    it('returns unsafe integers as numbers when BigInts are disabled', () => {
+      const { cleanup, db } = createTestDatabase({ numbers: { unsafe: BigInt(2) ** BigInt(60) } })
+
+      setBigIntPolicy('never')
+      expect(getDocumentProperties(getDocument(db, 'numbers')!)).toEqual({ unsafe: 2 ** 60 })
+      setBigIntPolicy('unsafe')
+      expect(getDocumentProperties(getDocument(db, 'numbers')!)).toEqual({ unsafe: BigInt(2) ** BigInt(60) })
+
+      cleanup()
+    })
+
+    it('returns deeply nested and very large documents', () => {
+      let nested: Record<string, unknown> = { leaf: true }
+      for (let i = 0; i < 500; i++) nested = i % 2 ? { child: nested } : { children: [nested, i] }
+
+      const large = {
+        nested,
+        items: Array.from({ length: 5000 }, (_, i) => ({ id: i, tags: [`tag${i}`] })),
+        fields: Object.fromEntries(Array.from({ length: 2500 }, (_, i) => [`field${i}`, { value: i }]))
+      }
+      const { cleanup, db } = createTestDatabase({ large })
+
+      expect(getDocumentProperties(getDocument(db, 'large')!)).toEqual(large)
+
+      cleanup()
+    })
+  })
+
+  describe('getDocumentPropertiesById', () => {
+    it('reads properties without a document ref', () => {
+      const { cleanup, db } = createTestDatabase({ testDoc: { name: 'test', tags: ['a', 'b'] } })
+
+      expect(getDocumentPropertiesById(db, 'testDoc')).toEqual({ name: 'test', tags: ['a', 'b'] })
+      expect(getDocumentPropertiesById(db, 'missing')).toBeNull()
+
+      cleanup()
+    })
+  })
+
+  describe('getDocumentRevisionID', () => {
+    it('changes every time the document is saved', () => {
+      const { cleanup, db } = createTestDatabase({ person: { children: 2 } })
+      const doc = getMutableDocument(db, 'person')!
+      const revisionID = getDocumentRevisionID(doc)
+
+      expect(revisionID).toMatch(/^1-/)
+      expect(getDocumentRevisionID(createDocument())).toBeNull()
+
+      setDocumentProperties(doc, { children: 3 })
+      saveDocument(db, doc)
+      expect(getDocumentRevisionID(getDocument(db, 'person')!)).toMatch(/^2-/)
+
+      cleanup()
+    })
+  })
+
+  describe('getDocumentSequence', () => {
+    it('returns the sequence of a document ref or of a stored document', () => {
+      const { cleanup, db } = createTestDatabase({ person: { children: 2 } })
+      const doc = getMutableDocument(db, 'person')!
+      const sequence = getDocumentSequence(doc)
+
+      expect(sequence).toBeGreaterThan(0)
+      expect(getDocumentSequence(db, 'person')).toBe(sequence)
+      expect(getDocumentSequence(db, 'nobody')).toBeNull()
+
+      saveDocument(db, doc)
+      expect(getDocumentSequence(db, 'person')).toBeGreaterThan(sequence)
+
+      cleanup()
+    })
+  })
+
+  describe('getLazyDocumentProperties', () => {
+    const person = {
+      name: 'Stella Wade',
+      age: 42,
+      tags: ['parent', { role: 'admin' }],
+      spouse: { name: 'Ronald Todd', active: false }
+    }
+
+    it('reads fields on access', () => {
+      const { cleanup, db } = createTestDatabase({ person })
+
+      const properties = getLazyDocumentProperties<typeof person>(getDocument(db, 'person')!)
+      expect(properties.name).toBe('Stella Wade')
+      expect(properties.spouse.name).toBe('Ronald Todd')
+      expect(properties.tags[1]).toEqual({ role: 'admin' })
+      expect(properties.tags.length).toBe(2)
+      expect(Array.isArray(properties.tags)).toBe(true)
+      expect('age' in properties).toBe(true)
+      expect((properties as Record<string, unknown>).missing).toBeUndefined()
+
+      cleanup()
+    })
+
+    it('behaves like the fully converted properties', () => {
+      const { cleanup, db } = createTestDatabase({ person })
+
+      const properties = getLazyDocumentProperties(getDocument(db, 'person')!)
+      expect(Object.keys(properties as object)).toEqual(Object.keys(person))
+      expect(JSON.parse(JSON.stringify(properties))).toEqual(person)
+      expect(properties).toEqual(person)
+
+      cleanup()
+    })
+
+    it('is read-only', () => {
+      const { cleanup, db } = createTestDatabase({ person })
+
+      const properties = getLazyDocumentProperties<typeof person>(getDocument(db, 'person')!)
+      expect(() => { properties.name = 'Polly Todd' }).toThrowError('Lazy document properties are read-only')
+
+      cleanup()
+    })
+  })
+
+  describe('purgeDocuments', () => {
+    it('purges documents in one call', () => {
+      const { cleanup, db } = createTestDatabase({ doc1: { n: 1 }, doc2: { n: 2 }, doc3: { n: 3 } })
+
+      expect(purgeDocuments(db, ['doc1', 'doc3', 'missing'])).toBe(2)
+      expect(getDocument(db, 'doc1')).toBeNull()
+      expect(getDocument(db, 'doc2')).not.toBeNull()
+      expect(getDocument(db, 'doc3')).toBeNull()
+      expect(purgeDocuments(db, [])).toBe(0)
+
+      cleanup()
+    })
+  })
+
+  describe('putDocument', () => {
+    it('creates and replaces documents without a document ref', () => {
+      const { cleanup, db } = createTestDatabase()
+
+      expect(putDocument(db, 'testDoc', { name: 'one', count: 1 })).toBe(true)
+      expect(getDocumentProperties(getDocument(db, 'testDoc')!)).toEqual({ name: 'one', count: 1 })
+
+      expect(putDocument(db, 'testDoc', { name: 'two' })).toBe(true)
+      expect(getDocumentPropertiesById(db, 'testDoc')).toEqual({ name: 'two' })
+
+      expect(putDocument(db, 'testDoc', { name: 'three' }, { concurrency: 'failOnConflict' })).toBe(false)
+      expect(putDocument(db, 'testDoc', { count: 3 }, { merge: 'shallow' })).toBe(true)
+      expect(getDocumentPropertiesById(db, 'testDoc')).toEqual({ name: 'two', count: 3 })
+
+      cleanup()
+    })
+  })
+
+  describe('saveDocument', () => {
+    it('fails on conflict when asked to', () => {
+      const { cleanup, db } = createTestDatabase({ testDoc: { count: 1 } })
+      const doc1 = getMutableDocument(db, 'testDoc')!
+      const doc2 = getMutableDocument(db, 'testDoc')!
+
+      setDocumentProperties(doc1, { count: 2 })
+      expect(saveDocument(db, doc1, { concurrency: 'failOnConflict' })).toBe(true)
+
+      setDocumentProperties(doc2, { count: 3 })
+      expect(saveDocument(db, doc2, { concurrency: 'failOnConflict' })).toBe(false)
+      expect(getDocumentProperties(getDocument(db, 'testDoc')!)).toEqual({ count: 2 })
+
+      expect(saveDocument(db, doc2, { concurrency: 'lastWriteWins' })).toBe(true)
+      expect(getDocumentProperties(getDocument(db, 'testDoc')!)).toEqual({ count: 3 })
+
+      cleanup()
+    })
+
+    it('merges with a conflicting revision', () => {
+      const { cleanup, db } = createTestDatabase({ testDoc: { name: 'one', address: { city: 'Oslo' } } })
+      const doc1 = getMutableDocument(db, 'testDoc')!
+      const doc2 = getMutableDocument(db, 'testDoc')!
+      const doc3 = getMutableDocument(db, 'testDoc')!
+
+      setDocumentProperties(doc1, { name: 'one', address: { city: 'Oslo', zip: '0150' }, tags: ['a'] })
+      saveDocument(db, doc1)
+
+      setDocumentProperties(doc2, { name: 'two', address: { country: 'NO' } })
+      expect(saveDocument(db, doc2, { merge: 'deep' })).toBe(true)
+      expect(getDocumentProperties(getDocument(db, 'testDoc')!)).toEqual({ name: 'two', address: { city: 'Oslo', zip: '0150', country: 'NO' }, tags: ['a'] })
+
+      setDocumentProperties(doc3, { name: 'three', address: { country: 'SE' } })
+      expect(saveDocument(db, doc3, { merge: 'shallow' })).toBe(true)
+      expect(getDocumentProperties(getDocument(db, 'testDoc')!)).toEqual({ name: 'three', address: { country: 'SE' }, tags: ['a'] })
+
+      cleanup()
+    })
+
+    it('rejects unknown options', () => {
+      const { cleanup, db } = createTestDatabase()
+      const doc = createDocument()
+
+      expect(() => saveDocument(db, doc, { concurrency: 'sometimes' } as never)).toThrow(TypeError)
+      expect(() => saveDocument(db, doc, { concurrency: 'failOnConflict', merge: 'deep' } as never)).toThrow(TypeError)
+
+      cleanup()
+    })
+  })
+
+  describe('saveDocumentAsync', () => {
+    it('saves documents off the JS thread', async () => {
+      const { cleanup, db } = createTestDatabase()
+      const docs = Array.from({ length: 20 }, (_, i) => {
+        const doc = createDocument(`doc-${i}`)
+        setDocumentProperties(doc, { index: i })
+        return doc
+      })
+
+      await expect(Promise.all(docs.map(doc => saveDocumentAsync(db, doc)))).resolves.toEqual(docs.map(() => true))
+      expect(getDocumentProperties(getDocument(db, 'doc-19')!)).toEqual({ index: 19 })
+
+      cleanup()
+    })
+  })
+
+  describe('patchDocument', () => {
+    it('merges a patch into the document properties', () => {
+      const { cleanup, db } = createTestDatabase({
+        post: { title: 'Hello', status: 'draft', meta: { views: 1, author: 'Milo' }, tags: ['news'], obsolete: true }
+      })
+      const doc = getMutableDocument(db, 'post')!
+
+      patchDocument(doc, {
+        status: 'published',
+        meta: { views: patchIncrement(2), editor: 'Polly' },
+        tags: patchAppend(['kids', 'fun']),
+        obsolete: null,
+        title: patchRemove(),
+        comments: patchAppend('First!')
+      })
+
+      expect(getDocumentProperties(doc)).toEqual({
+        status: 'published',
+        meta: { views: 3, author: 'Milo', editor: 'Polly' },
+        tags: ['news', 'kids', 'fun'],
+        comments: ['First!']
+      })
+
+      cleanup()
+    })
+
+    it('rejects operations on fields of the wrong type', () => {
+      const { cleanup, db } = createTestDatabase({ post: { title: 'Hello' } })
+      const doc = getMutableDocument(db, 'post')!
+
+      expect(() => patchDocument(doc, { title: patchIncrement() })).toThrowError("Cannot $increment 'title': not a number")
+      expect(() => patchDocument(doc, { title: { $unknown: 1 } })).toThrowError("Unknown patch operation '$unknown'")
+
+      cleanup()
+    })
+  })
+
+  describe('patchAndSave', () => {
+    it('patches and saves a stored document, creating it if missing', () => {
+      const { cleanup, db } = createTestDatabase({ counter: { count: 41, name: 'visits' } })
+
+      patchAndSave(db, 'counter', { count: patchIncrement() })
+      patchAndSave(db, 'new-counter', { count: patchIncrement(5) })
+
+      expect(getDocuments(db, ['counter', 'new-counter'], { properties: true })).toEqual([
+        { count: 42, name: 'visits' },
+        { count: 5 }
+      ])
+
+      cleanup()
+    })
+  })
+
+  describe('saveDocuments', () => {
+    it('saves many documents in batched transactions', () => {
+      const { cleanup, db } = createTestDatabase()
+      const documents = Array.from({ length: 25 }, (_, i) => ({ id: `doc-${i}`, properties: { index: i } }))
+
+      const results = saveDocuments(db, documents, { batchSize: 10 })
+
+      expect(results).toEqual(documents.map(({ id }) => ({ id, saved: true })))
+      expect(getDocuments(db, ['doc-0', 'doc-24'], { properties: true })).toEqual([{ index: 0 }, { index: 24 }])
+
+      cleanup()
+    })
+
+    it('reports failed entries without stopping the others', () => {
+      const { cleanup, db } = createTestDatabase()
+
+      const results = saveDocuments(db, [
+        { id: 'good', properties: { ok: true } },
+        { id: 'bad', properties: 'not an object' as unknown as Record<string, unknown> },
+        { properties: { generated: true } }
+      ])
+
+      expect(results[0]).toEqual({ id: 'good', saved: true })
+      expect(results[1]).toMatchObject({ id: 'bad', saved: false, error: expect.any(Error) })
+      expect(results[2]).toEqual({ id: expect.stringMatching(/^~/), saved: true })
+
+      cleanup()
+    })
+
+    it('rejects an invalid batch size', () => {
+      const { cleanup, db } = createTestDatabase()
+
+      expect(() => saveDocuments(db, [], { batchSize: 0 })).toThrowError('batchSize must be a positive integer')
+      expect(() => saveDocuments(db, [], { batchSize: 2.5 })).toThrowError(RangeError)
+      expect(() => saveDocuments(db, [], { batchSize: NaN })).toThrowError(RangeError)
+      expect(() => saveDocuments(db, [], { batchSize: 2 ** 32 })).toThrowError(RangeError)
+      expect(() => saveDocuments(db, [], { batchSize: '10' as unknown as number })).toThrowError(new TypeError('Wrong arguments: batchSize must be a number'))
+      expect(() => saveDocuments(db, [], { batchSize: {} as unknown as number })).toThrowError(TypeError)
 
       cleanup()
     })
@@ -184,6 +674,30 @@ describe('document functions', () => {
       cleanup()
     })
 
+    it('stores Buffers and typed arrays as data and returns them as Buffers', () => {
+      const { cleanup, db } = createTestDatabase()
+      const large = Buffer.alloc(4096, 7)
+
+      const doc = createDocument('binary')
+      setDocumentProperties(doc, {
+        buffer: Buffer.from([1, 2, 3]),
+        typed: new Uint16Array([1, 256]),
+        view: new DataView(new Uint8Array([4, 5]).buffer),
+        large,
+        nested: [Buffer.from('hello')]
+      })
+      saveDocument(db, doc)
+
+      const properties = getDocumentProperties(getDocument(db, 'binary')!) as Record<string, unknown>
+      expect(properties.buffer).toEqual(Buffer.from([1, 2, 3]))
+      expect(properties.typed).toEqual(Buffer.from([1, 0, 0, 1]))
+      expect(properties.view).toEqual(Buffer.from([4, 5]))
+      expect(properties.large).toEqual(large)
+      expect(properties.nested).toEqual([Buffer.from('hello')])
+
+      cleanup()
+    })
+
     it('sets the data of a mutable document with an array', () => {
       const { cleanup, db } = createTestDatabase({ child: {} })
 
@@ -0,0 +1,116 @@
+import { getDocumentPropertiesRef, valueRefCount, valueRefGet, valueRefKeys, valueRefType } from '../cblite'
+import { DocumentRef, MutableDocumentRef, PatchOperation, ValueRef } from '../types'
+
+const readOnly = () => {
+  throw new TypeError('Lazy document properties are read-only')
+}
+
+const wrap = (value: unknown): unknown => {
+  if (typeof value !== 'object' || value === null) return value
+
+  switch (valueRefType(value)) {
+    case 'dict': return lazyDict(value as ValueRef)
+    case 'array': return lazyArray(value as ValueRef)
+    default: return value
+  }
+}
+
+const lazyDict = (ref: ValueRef): Record<string, unknown> => {
+  const values = new Map<string, unknown>()
+  let keys: string[] | undefined
+  let keySet: Set<string> | undefined
+
+  const getKeys = () => (keys ??= valueRefKeys(ref))
+  const hasKey = (key: string | symbol): key is string =>
+    typeof key === 'string' && (keySet ??= new Set(getKeys())).has(key)
+  const get = (key: string) => {
+    if (!values.has(key)) values.set(key, wrap(valueRefGet(ref, key)))
+
+    return values.get(key)
+  }
+
+  return new Proxy({}, {
+    // Reading a field does not need the key list, so reading a couple of fields only decodes those fields
+    get: (target, key) => {
+      if (typeof key === 'symbol') return Reflect.get(target, key)
+      if (values.has(key)) return values.get(key)
+
+      const value = valueRefGet(ref, key)
+
+      if (value === undefined) return Reflect.get(target, key)
+
+      values.set(key, wrap(value))
+
+      return values.get(key)
+    },
+    has: (target, key) => hasKey(key),
+    ownKeys: () => getKeys(),
+    getOwnPropertyDescriptor: (target, key) => hasKey(key)
+      ? { configurable: true, enumerable: true, writable: false, value: get(key) }
+      : undefined,
+    set: readOnly,
+    defineProperty: readOnly,
+    deleteProperty: readOnly
+  })
+}
+
+const lazyArray = (ref: ValueRef): unknown[] => {
+  const length = valueRefCount(ref)
+  const values = new Map<number, unknown>()
+
+  const toIndex = (key: string | symbol) => {
+    if (typeof key === 'symbol') return -1
+
+    const index = Number(key)
+
+    return Number.isInteger(index) && index >= 0 && index < length && String(index) === key ? index : -1
+  }
+  const get = (index: number) => {
+    if (!values.has(index)) values.set(index, wrap(valueRefGet(ref, index)))
+
+    return values.get(index)
+  }
+
+  // The target carries the array's length so Array.isArray and Array.prototype methods work on the proxy
+  return new Proxy(new Array(length), {
+    get: (target, key) => {
+      const index = toIndex(key)
+
+      return index === -1 ? Reflect.get(target, key) : get(index)
+    },
+    has: (target, key) => toIndex(key) !== -1 || Reflect.has(target, key),
+    ownKeys: target => [...Array.from({ length }, (_, index) => String(index)), ...Reflect.ownKeys(target)],
+    getOwnPropertyDescriptor: (target, key) => {
+      const index = toIndex(key)
+
+      return index === -1
+        ? Reflect.getOwnPropertyDescriptor(target, key)
+        : { configurable: true, enumerable: true, writable: false, value: get(index) }
+    },
+    set: readOnly,
+    defineProperty: readOnly,
+    deleteProperty: readOnly
+  })
+}
+
+/**
+ * Get a read-only view of a document's properties that only decodes the fields that are read.
+ * Nested dicts and arrays are decoded when they are first accessed. Use `getDocumentProperties` to get a mutable copy.
+ */
+export const getLazyDocumentProperties = <T = unknown>(doc: DocumentRef<T> | MutableDocumentRef<T>): T =>
+  lazyDict(getDocumentPropertiesRef(doc)) as unknown as T
+
+/**
+ * Patch operation that adds `by` to a numeric field, treating a missing field as 0.
+ */
+export const patchIncrement = (by = 1): PatchOperation => ({ $increment: by })
+
+/**
+ * Patch operation that appends to an array field, creating it if missing. Arrays are concatenated.
+ */
+export const patchAppend = (value: unknown): PatchOperation => ({ $append: value })
+
+/**
+ * Patch operation that removes a field, the same as patching it with `null`.
+ */
+export const patchRemove = (): PatchOperation => ({ $remove: true })
@@ -0,0 +1,66 @@
+import { createQuery, executeQuery, executeQueryFleece, getDocument, getDocumentFleece, getDocumentProperties } from '../cblite'
+import { decodeFleece } from './Fleece'
+import { createTestDatabase } from './test-util'
+
+describe('fleece functions', () => {
+  describe('decodeFleece', () => {
+    it('decodes inline scalars', () => {
+      expect(decodeFleece(new Uint8Array([0x00, 0x2a]))).toBe(42)
+      expect(decodeFleece(new Uint8Array([0x0f, 0xff]))).toBe(-1)
+      expect(decodeFleece(new Uint8Array([0x30, 0x00]))).toBeNull()
+      expect(decodeFleece(new Uint8Array([0x38, 0x00]))).toBe(true)
+    })
+
+    it('follows the trailing root pointer', () => {
+      expect(decodeFleece(new Uint8Array([0x42, 0x68, 0x69, 0x00, 0x80, 0x02]))).toBe('hi')
+    })
+
+    it('rejects data that is not Fleece', () => {
+      expect(() => decodeFleece(new Uint8Array([0x01]))).toThrowError('Invalid Fleece data')
+    })
+  })
+
+  describe('getDocumentFleece', () => {
+    it('decodes to the same value as getDocumentProperties', () => {
+      const person = {
+        name: 'Stella Wade',
+        bio: 'A string long enough to need a varint length prefix in Fleece',
+        emoji: '🏡',
+        active: true,
+        age: 42,
+        height: 5.4,
+        balance: -123456789,
+        favoriteNumber: BigInt(Number.MAX_SAFE_INTEGER) * BigInt(2),
+        children: [{ name: 'Polly Todd', age: 12 }, 'Beatrice Baker', null, 6.6],
+        spouse: { name: 'Ronald Todd', active: false }
+      }
+      const { cleanup, db } = createTestDatabase({ person })
+
+      const doc = getDocument(db, 'person')!
+      expect(getDocumentFleece(doc)).toBeInstanceOf(ArrayBuffer)
+      expect(decodeFleece(getDocumentFleece(doc))).toEqual(getDocumentProperties(doc))
+
+      cleanup()
+    })
+
+    it('decodes wide documents', () => {
+      const wide = Object.fromEntries(Array.from({ length: 3000 }, (_, i) => [`field${i}`, i]))
+      const { cleanup, db } = createTestDatabase({ wide })
+
+      expect(decodeFleece(getDocumentFleece(getDocument(db, 'wide')!))).toEqual(wide)
+
+      cleanup()
+    })
+  })
+
+  describe('executeQueryFleece', () => {
+    it('decodes to the same results as executeQuery', () => {
+      const { cleanup, db } = createTestDatabase({ doc1: { type: 'parent', name: 'Mom' }, doc2: { type: 'child', name: 'Milo' } })
+      const query = createQuery(db, 'SELECT _id, * FROM _ AS value ORDER BY name')
+
+      expect(decodeFleece(executeQueryFleece(query))).toEqual(executeQuery(query))
+
+      cleanup()
+    })
+  })
+})
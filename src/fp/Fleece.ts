@@ -0,0 +1,191 @@
+import { TextDecoder } from 'util'
+
+// Value tags, stored in the high nibble of a value's first byte
+const SHORT_INT_TAG = 0x0
+const INT_TAG = 0x1
+const FLOAT_TAG = 0x2
+const SPECIAL_TAG = 0x3
+const STRING_TAG = 0x4
+const BINARY_TAG = 0x5
+const ARRAY_TAG = 0x6
+const DICT_TAG = 0x7
+
+const SPECIAL_NULL = 0x0
+const SPECIAL_FALSE = 0x4
+const SPECIAL_TRUE = 0x8
+
+const LONG_COLLECTION_COUNT = 0x7ff
+const EXTERN_POINTER_FLAG = 0x40
+
+const textDecoder = new TextDecoder()
+
+/**
+ * Decode Fleece data, as returned by `getDocumentFleece` or `executeQueryFleece`, into plain JS values.
+ * Data values are returned as Buffers sharing memory with `data`.
+ */
+export function decodeFleece<T = unknown>(data: ArrayBuffer | ArrayBufferView): T {
+  const bytes = data instanceof ArrayBuffer
+    ? new Uint8Array(data)
+    : new Uint8Array(data.buffer, data.byteOffset, data.byteLength)
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength)
+
+  if (bytes.length < 2 || bytes.length % 2 !== 0) throw new Error('Invalid Fleece data')
+
+  const isPointer = (pos: number) => bytes[pos] >= 0x80
+
+  const deref = (pos: number, wide: boolean) => {
+    if (bytes[pos] & EXTERN_POINTER_FLAG) throw new Error('Fleece data with external pointers is not supported')
+
+    const offset = wide
+      ? ((bytes[pos] & 0x3f) * 0x1000000 + (bytes[pos + 1] << 16) + (bytes[pos + 2] << 8) + bytes[pos + 3]) * 2
+      : (((bytes[pos] & 0x3f) << 8) | bytes[pos + 1]) * 2
+
+    return pos - offset
+  }
+
+  // Returns [value, byte length]
+  const readVarint = (pos: number): [number, number] => {
+    let value = 0
+    let shift = 1
+    let length = 0
+    let byte: number
+
+    do {
+      byte = bytes[pos + length++]
+      value += (byte & 0x7f) * shift
+      shift *= 0x80
+    } while (byte & 0x80)
+
+    return [value, length]
+  }
+
+  const readInt = (pos: number, length: number, unsigned: boolean): number | bigint => {
+    const negative = !unsigned && (bytes[pos + length] & 0x80) !== 0
+
+    if (length <= 6) {
+      let value = 0
+
+      for (let i = length; i > 0; i--) value = value * 0x100 + bytes[pos + i]
+
+      return negative ? value - 2 ** (length * 8) : value
+    }
+
+    let value = BigInt(0)
+
+    for (let i = length; i > 0; i--) value = (value << BigInt(8)) | BigInt(bytes[pos + i])
+    if (negative) value -= BigInt(1) << BigInt(length * 8)
+
+    return value >= BigInt(Number.MIN_SAFE_INTEGER) && value <= BigInt(Number.MAX_SAFE_INTEGER) ? Number(value) : value
+  }
+
+  // Returns [start, length] of a string or binary value's bytes
+  const readBytes = (pos: number): [number, number] => {
+    const size = bytes[pos] & 0x0f
+
+    if (size < 0x0f) return [pos + 1, size]
+
+    const [longSize, varintLength] = readVarint(pos + 1)
+
+    return [pos + 1 + varintLength, longSize]
+  }
+
+  const readString = (pos: number) => {
+    const [start, length] = readBytes(pos)
+
+    // Short ASCII strings are cheaper to build directly than through TextDecoder
+    if (length <= 16) {
+      let ascii = ''
+
+      for (let i = start; i < start + length; i++) {
+        if (bytes[i] >= 0x80) return textDecoder.decode(bytes.subarray(start, start + length))
+        ascii += String.fromCharCode(bytes[i])
+      }
+
+      return ascii
+    }
+
+    return textDecoder.decode(bytes.subarray(start, start + length))
+  }
+
+  // Returns [first item position, count, item width]
+  const readCollection = (pos: number): [number, number, number] => {
+    const width = bytes[pos] & 0x08 ? 4 : 2
+    let count = ((bytes[pos] & 0x07) << 8) | bytes[pos + 1]
+    let first = pos + 2
+
+    if (count === LONG_COLLECTION_COUNT) {
+      const [extraCount, varintLength] = readVarint(first)
+
+      count += extraCount
+      first += varintLength + (varintLength & 1)
+    }
+
+    return [first, count, width]
+  }
+
+  const readItem = (pos: number, width: number): unknown =>
+    readValue(isPointer(pos) ? deref(pos, width === 4) : pos)
+
+  const readValue = (pos: number): unknown => {
+    const byte = bytes[pos]
+
+    switch (byte >> 4) {
+      case SHORT_INT_TAG: {
+        const value = ((byte & 0x0f) << 8) | bytes[pos + 1]
+
+        return value & 0x800 ? value - 0x1000 : value
+      }
+      case INT_TAG:
+        return readInt(pos, (byte & 0x07) + 1, (byte & 0x08) !== 0)
+      case FLOAT_TAG:
+        return byte & 0x08 ? view.getFloat64(pos + 2, true) : view.getFloat32(pos + 2, true)
+      case SPECIAL_TAG:
+        switch (byte & 0x0f) {
+          case SPECIAL_NULL: return null
+          case SPECIAL_FALSE: return false
+          case SPECIAL_TRUE: return true
+          default: return undefined
+        }
+      case STRING_TAG:
+        return readString(pos)
+      case BINARY_TAG: {
+        const [start, length] = readBytes(pos)
+
+        return Buffer.from(bytes.buffer, bytes.byteOffset + start, length)
+      }
+      case ARRAY_TAG: {
+        const [first, count, width] = readCollection(pos)
+        const array = new Array(count)
+
+        for (let i = 0; i < count; i++) array[i] = readItem(first + i * width, width)
+
+        return array
+      }
+      case DICT_TAG: {
+        const [first, count, width] = readCollection(pos)
+        const dict: Record<string, unknown> = {}
+
+        for (let i = 0; i < count; i++) {
+          const keyPos = first + 2 * i * width
+
+          dict[String(readItem(keyPos, width))] = readItem(keyPos + width, width)
+        }
+
+        return dict
+      }
+      default:
+        return readValue(deref(pos, false))
+    }
+  }
+
+  // The root is found through the trailing 2-byte pointer, which points at a wide pointer when the root is too far away
+  let root = bytes.length - 2
+
+  if (isPointer(root)) {
+    root = deref(root, false)
+
+    if (isPointer(root)) root = deref(root, true)
+  }
+
+  return readValue(root) as T
+}
@@ -17,6 +17,7 @@ export {
   closeBlobReader,
   closeBlobWriter,
   closeDatabase,
+  compileKeyPath,
   createBlobWithData,
   createBlobWithStream,
   createBlobWriter,
@@ -27,31 +28,63 @@ export {
   databaseName,
   databasePath,
   databaseSaveBlob,
+  databaseStats,
   deleteDatabase,
   deleteDocument,
+  deleteDocumentAsync,
+  disableDocumentCache,
+  documentCacheStats,
   documentGetBlob,
   documentIsBlob,
   documentSetBlob,
   documentsPendingReplication,
+  enableDocumentCache,
   endTransaction,
   executeQuery,
+  executeQueryFleece,
   explainQuery,
   getDocument,
+  getDocumentAsync,
+  getDocumentExpiration,
+  getDocumentFields,
+  getDocumentFleece,
   getDocumentID,
   getDocumentProperties,
+  getDocumentPropertiesById,
+  getDocumentPropertiesRef,
+  getDocumentRevisionID,
+  getDocumentSequence,
+  getDocuments,
+  getDocumentsAsync,
   getMutableDocument,
+  getMutableDocumentAsync,
   getQueryParameters,
   isDocumentPendingReplication,
   openBlobContentStream,
   openDatabase,
+  openDatabaseAsync,
+  patchAndSave,
+  patchDocument,
+  performMaintenance,
+  purgeDocuments,
+  putDocument,
   readBlobReader,
   replicatorConfiguration,
   replicatorStatus,
   saveDocument,
+  saveDocumentAsync,
+  saveDocuments,
+  setBigIntPolicy,
+  setDocumentExpiration,
   setDocumentProperties,
   setQueryParameters,
   startReplicator,
   stopReplicator,
+  transactionStats,
+  valueRefCount,
+  valueRefGet,
+  valueRefKeys,
+  valueRefType,
   writeBlobWriter
 } from './cblite'
 export {
@@ -60,11 +93,19 @@ export {
   BlobRef,
   BlobWriteStreamRef,
   DatabaseChangeListener,
+  DatabaseFileSizes,
   DatabaseRef,
+  DatabaseStats,
+  DocumentCacheStats,
   DocumentChangeListener,
+  DocumentPatch,
   DocumentRef,
   DocumentReplicationListener,
+  KeyPathRef,
+  MaintenanceResult,
+  MaintenanceType,
   MutableDocumentRef,
+  PatchOperation,
   QueryChangeListener,
   QueryLanguage,
   QueryRef,
@@ -76,10 +117,22 @@ export {
   ReplicatorChangeListener,
   ReplicatorConfiguration,
   ReplicatorRef,
-  ReplicatorStatus
+  ReplicatorStatus,
+  SaveDocumentOptions,
+  SaveDocumentsEntry,
+  SaveDocumentsResult,
+  TransactionStats,
+  ValueRef
 } from './types'
 export {
+  RunInTransactionOptions,
+  WriteCoalescer,
+  WriteCoalescerOptions,
   abortTransaction,
-  commitTransaction
+  commitTransaction,
+  createWriteCoalescer,
+  runInTransaction
 } from './fp/Database'
+export { getLazyDocumentProperties, patchAppend, patchIncrement, patchRemove } from './fp/Document'
+export { decodeFleece } from './fp/Fleece'
 export * from './fp/scope'
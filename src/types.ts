@@ -18,24 +18,113 @@ export interface DatabaseRef extends Symbol {
   type: 'Database'
 }
 
+/**
+ * As returned by `databaseStats`. `lastSequence` is the sequence of the most recently changed live document.
+ */
+export interface DatabaseStats {
+  count: number
+  lastSequence: number
+  fileSizes: DatabaseFileSizes
+}
+
+/**
+ * Counters of a database's document cache, as returned by `documentCacheStats`. `count` is the number of cached
+ * documents and `capacity` the most it holds.
+ */
+export interface DocumentCacheStats {
+  hits: number
+  misses: number
+  evictions: number
+  invalidations: number
+  count: number
+  capacity: number
+}
+
+/**
+ * Bytes on disk of a database bundle: the SQLite file, its write-ahead log (`wal`) and shared memory index (`shm`),
+ * and the blob attachments. `total` also counts anything else in the bundle.
+ */
+export interface DatabaseFileSizes {
+  total: number
+  sqlite: number
+  wal: number
+  shm: number
+  attachments: number
+}
+
 export interface DocumentRef<T = unknown> extends Symbol {
   __: T
   type: 'Document'
   mutable: false
 }
 
+/**
+ * Compiled key path such as `'a.b'` or `'tags[0]'`, as returned by `compileKeyPath`.
+ */
+export interface KeyPathRef extends Symbol {
+  type: 'KeyPath'
+}
+
+export type MaintenanceType = 'compact' | 'reindex' | 'integrityCheck' | 'optimize' | 'fullOptimize'
+
+/**
+ * Result of `performMaintenance`, with the bundle's size on disk before and after it ran.
+ */
+export interface MaintenanceResult {
+  type: MaintenanceType
+  before: DatabaseFileSizes
+  after: DatabaseFileSizes
+  durationMs: number
+}
+
 export interface MutableDocumentRef<T = unknown> extends Symbol {
   __: T
   type: 'MutableDocument'
   mutable: true
 }
 
+export type PatchOperation = { $increment: number } | { $append: unknown } | { $remove: true }
+
+/**
+ * JSON merge patch (RFC 7386): `null` removes a field, objects are merged recursively and anything else replaces the
+ * field. An object with a single `$`-prefixed key is a {@link PatchOperation}.
+ */
+export type DocumentPatch = { [key: string]: unknown }
+
 export interface QueryRef<T = unknown, P = Record<string, string>> extends Symbol {
   __: T
   ___: P
   type: 'Query'
 }
 
+/**
+ * Opaque reference to a Fleece dict or array inside a document, decoded on access.
+ */
+export interface ValueRef extends Symbol {
+  type: 'Value'
+}
+
+export interface SaveDocumentsEntry<T = unknown> {
+  id?: string
+  properties: T
+}
+
+/**
+ * How `saveDocument` resolves a conflict with a revision saved since the document was read. `failOnConflict` saves
+ * nothing and returns `false`. The `merge` strategies set the properties being saved on top of the stored revision's,
+ * `shallow` at the top level only and `deep` within nested objects too, so keys removed by the caller reappear if
+ * the other revision has them.
+ */
+export type SaveDocumentOptions =
+  | { concurrency?: 'lastWriteWins' | 'failOnConflict', merge?: undefined }
+  | { concurrency?: undefined, merge: 'shallow' | 'deep' }
+
+export interface SaveDocumentsResult {
+  id: string | null
+  saved: boolean
+  error?: Error
+}
+
 export interface ReplicatorRef extends Symbol {
   type: 'Replicator'
 }
@@ -74,6 +163,16 @@ export interface ReplicatorStatus {
 }
 
 export type DatabaseChangeListener = (docIDs: string[]) => void
+/**
+ * The current transaction on a database ref, or the last one once it has ended, as returned by `transactionStats`.
+ * `ops` counts the writes made through the ref since the outermost transaction began.
+ */
+export interface TransactionStats {
+  depth: number
+  ops: number
+  durationMs: number
+}
+
 export type RemoveDatabaseChangeListener = () => void
 
 export type DocumentChangeListener = (docID: string) => void